@@ -1,3 +1,6 @@
+// madvise, pread, syscall, MAP_ANONYMOUS and st_mtim are not part of ISO C
+#define _GNU_SOURCE
+
 #include "csvParser.h"
 
 #include <stdio.h>
@@ -6,6 +9,21 @@
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#ifdef CSV_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSV_WITH_ZSTD
+#include <zstd.h>
+#endif
 
 static HashTable indexTable = {0};
 static s32 globalError = NIL;
@@ -43,6 +61,7 @@ static void print_error() {
         case ERR_CSV_DIFF_TYPE:
             printf("Erro: Tipo de dado incompatível.\n");
             break;
+        case ERR_COLUMN_NOT_FOUND:
         case ERR_INVALID_COLUMN:
             printf("Erro: Nome de coluna inválido ou inexistente.\n");
             break;
@@ -52,6 +71,24 @@ static void print_error() {
         case ERR_INCONSISTENT_COLUMNS:
             printf("Erro: Número inconsistente de colunas entre as linhas do CSV.\n");
             break;
+        case ERR_MAP_FILE:
+            printf("Erro: Falha ao mapear o arquivo na memória.\n");
+            break;
+        case ERR_READ_FILE:
+            printf("Erro: Falha ao ler o arquivo.\n");
+            break;
+        case ERR_WRITE_FILE:
+            printf("Erro: Falha ao escrever o arquivo.\n");
+            break;
+        case ERR_COMPRESSION:
+            printf("Erro: Formato de compressão não suportado ou arquivo corrompido.\n");
+            break;
+        case ERR_CACHE_STALE:
+            printf("Erro: Cache desatualizado ou inválido.\n");
+            break;
+        case ERR_SOURCE_CHANGED:
+            printf("Erro: O arquivo foi truncado desde a última leitura.\n");
+            break;
         case ERR_UNKNOWN:
         default:
             printf("Erro desconhecido.\n");
@@ -73,7 +110,7 @@ boolean error()
 
 Region *new_region(size_t capacity)
 {
-    size_t bytes = sizeof(Region) + (sizeof(uintptr_t) * capacity);
+    size_t bytes = sizeof(Region) + capacity;
     Region *region = (Region *)malloc(bytes);
     if (region == NULL)
     {
@@ -82,61 +119,238 @@ Region *new_region(size_t capacity)
     region->next = NULL;
     region->size = 0;
     region->capacity = capacity;
+    region->mapped = 0;
     return region;
 }
 
 void free_region(Region *r)
 {
+    if (r->mapped)
+    {
+        munmap(r, r->mapped);
+        return;
+    }
     free(r);
 }
 
-void *arena_alloc(Arena *a, size_t bytes)
+#if defined(MAP_ANONYMOUS) && defined(MADV_HUGEPAGE)
+
+#if defined(SYS_getcpu) && defined(SYS_mbind)
+/*
+ * Makes the pages of [addr, addr + bytes) prefer the NUMA node of the calling thread.
+ * @return s32: 1 on success, 0 if the kernel refused.
+ */
+static s32 bind_to_local_node(void *addr, size_t bytes)
 {
-    size_t aligned_size = ALIGN_UP(bytes, ALIGNMENT);
-    if (a->end == NULL)
+    unsigned int cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= 64)
     {
-        assert(a->begin == NULL);
-        size_t capacity = REGION_DEFAULT_CAPACITY;
-        if (capacity < aligned_size)
-        {
-            capacity = aligned_size;
-        } 
-        a->end = new_region(capacity);
-        if (a->end == NULL)
+        return 0;
+    }
+    unsigned long nodemask = 1UL << node;
+    // MPOL_PREFERRED, so a full node falls back to the others
+    return syscall(SYS_mbind, addr, bytes, 1, &nodemask, sizeof(nodemask) * 8 + 1, 0) == 0;
+}
+#else
+static s32 bind_to_local_node(void *addr, size_t bytes)
+{
+    (void)addr;
+    (void)bytes;
+    return 0;
+}
+#endif
+
+/*
+ * Maps a region at a huge page boundary, so transparent huge pages can back
+ * it, with its size rounded up to whole huge pages. Sets ARENA_BACKING_FAILED
+ * in *backing when the kernel refuses the huge page or NUMA advice.
+ * @return: The region, NULL if the mapping failed.
+ */
+static Region *map_region(size_t capacity, u32 *backing)
+{
+    size_t bytes = ALIGN_UP(sizeof(Region) + capacity, (size_t)HUGE_PAGE_SIZE);
+    u8 *mapping = mmap(NULL, bytes + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    // Trim the extra huge page around the aligned part
+    u8 *begin = (u8 *)ALIGN_UP((uintptr_t)mapping, (uintptr_t)HUGE_PAGE_SIZE);
+    if (begin > mapping)
+    {
+        munmap(mapping, begin - mapping);
+    }
+    if (mapping + HUGE_PAGE_SIZE > begin)
+    {
+        munmap(begin + bytes, mapping + HUGE_PAGE_SIZE - begin);
+    }
+
+    if (madvise(begin, bytes, MADV_HUGEPAGE) != 0 ||
+        ((*backing & ARENA_NUMA_LOCAL) && !bind_to_local_node(begin, bytes)))
+    {
+        *backing |= ARENA_BACKING_FAILED;
+    }
+
+    Region *region = (Region *)begin;
+    region->next = NULL;
+    region->size = 0;
+    region->capacity = bytes - sizeof(Region);
+    region->mapped = bytes;
+    return region;
+}
+
+#else
+
+// No huge page or NUMA support here, arena_new_region falls back to malloc
+static Region *map_region(size_t capacity, u32 *backing)
+{
+    (void)capacity;
+    (void)backing;
+    return NULL;
+}
+
+#endif
+
+/*
+ * A region from the backing of a, malloc'd when small. A region that cannot
+ * be mapped is malloc'd too, and recorded with ARENA_BACKING_FAILED.
+ */
+static Region *arena_new_region(Arena *a, size_t capacity)
+{
+    if ((a->backing & ARENA_HUGE_PAGES) && capacity >= HUGE_PAGE_SIZE)
+    {
+        Region *region = map_region(capacity, &a->backing);
+        if (region)
         {
-            return NULL;
+            return region;
         }
-        a->begin = a->end;
+        a->backing |= ARENA_BACKING_FAILED;
+    }
+    return new_region(capacity);
+}
+
+// Regions double from REGION_DEFAULT_CAPACITY up to REGION_MAX_CAPACITY, bigger if bytes needs it
+static size_t next_region_capacity(const Region *last, size_t bytes)
+{
+    size_t capacity = last ? last->capacity * 2 : REGION_DEFAULT_CAPACITY;
+    if (capacity > REGION_MAX_CAPACITY)
+    {
+        capacity = REGION_MAX_CAPACITY;
+    }
+    if (capacity < bytes)
+    {
+        capacity = bytes;
+    }
+    return capacity;
+}
+
+static inline void arena_set_requested(Arena *a, u64 requested)
+{
+    a->requested = requested;
+    if (requested > a->peak)
+    {
+        a->peak = requested;
     }
+}
 
-    while (a->end->size + aligned_size > a->end->capacity && a->end->next != NULL)
+// Moves a->end to the first region from it with room for bytes, NULL if there is none.
+// a->last only grows in place inside a->end, so it is dropped when a->end moves.
+static Region *arena_find(Arena *a, size_t bytes)
+{
+    if (a->end == NULL)
+    {
+        return NULL;
+    }
+    while (a->end->size + bytes > a->end->capacity && a->end->next != NULL)
     {
         a->end = a->end->next;
+        a->last = NULL;
     }
+    return a->end->size + bytes <= a->end->capacity ? a->end : NULL;
+}
 
-    if (a->end->size + aligned_size > a->end->capacity) 
+void *arena_alloc(Arena *a, size_t bytes)
+{
+    size_t aligned_size = ALIGN_UP(bytes, ALIGNMENT);
+    Region *region = arena_find(a, aligned_size);
+    if (region == NULL)
     {
-        assert(a->end->next == NULL);
-        size_t capacity = REGION_DEFAULT_CAPACITY;
-        if (capacity < aligned_size)
-        {
-            capacity = aligned_size;
-        } 
-        a->end->next = new_region(capacity);
-        if (a->end->next == NULL)
+        size_t capacity = next_region_capacity(a->end, aligned_size);
+        region = arena_new_region(a, capacity);
+        if (region == NULL)
         {
             return NULL;
         }
-        a->end = a->end->next;
+
+        if (a->end == NULL)
+        {
+            assert(a->begin == NULL);
+            a->begin = region;
+            a->end = region;
+        }
+        else if (capacity == aligned_size)
+        {
+            // Too big for the next region, give it one of its own so the
+            // free space of the current one stays in use
+            region->next = a->large;
+            a->large = region;
+        }
+        else
+        {
+            a->end->next = region;
+            a->end = region;
+        }
     }
 
-    void *alloced_bytes = &a->end->data[a->end->size];
-    a->end->size += aligned_size;
+    void *alloced_bytes = &region->data[region->size];
+    region->size += aligned_size;
+    a->last = region == a->end ? alloced_bytes : NULL;
+    arena_set_requested(a, a->requested + bytes);
     return alloced_bytes;
 }
 
+s32 arena_reserve(Arena *a, size_t bytes)
+{
+    size_t aligned_size = ALIGN_UP(bytes, ALIGNMENT);
+    if (arena_find(a, aligned_size))
+    {
+        return 1;
+    }
+
+    Region *region = arena_new_region(a, next_region_capacity(a->end, aligned_size));
+    if (region == NULL)
+    {
+        return 0;
+    }
+    if (a->end == NULL)
+    {
+        a->begin = region;
+    }
+    else
+    {
+        a->end->next = region;
+    }
+    a->end = region;
+    a->last = NULL;
+    return 1;
+}
+
 void *arena_realloc(Arena *a, void *_oldptr, size_t _oldsize, size_t _newsize)
 {
+    if (_oldptr != NULL && _oldptr == a->last)
+    {
+        // The most recent allocation grows, or gives space back, in place
+        size_t offset = a->last - a->end->data;
+        size_t aligned_size = ALIGN_UP(_newsize, ALIGNMENT);
+        if (offset + aligned_size <= a->end->capacity)
+        {
+            a->end->size = offset + aligned_size;
+            arena_set_requested(a, a->requested + _newsize - _oldsize);
+            return _oldptr;
+        }
+    }
+
     if (_newsize <= _oldsize)
     {
         return _oldptr;
@@ -147,20 +361,31 @@ void *arena_realloc(Arena *a, void *_oldptr, size_t _oldsize, size_t _newsize)
     {
         return NULL;
     }
-
-    s8 *_newptr_char = _newptr;
-    s8 *_oldptr_char = _oldptr;
     memcpy(_newptr, _oldptr, _oldsize); 
     return _newptr;
 }
 
+// Frees the large allocations made after until, which is one of them or NULL
+static void free_large(Arena *a, Region *until)
+{
+    while (a->large != until)
+    {
+        Region *r = a->large;
+        a->large = r->next;
+        free_region(r);
+    }
+}
+
 void arena_reset(Arena *a)
 {
     for (Region *r = a->begin; r != NULL; r = r->next)
     {
         r->size = 0;
     }
+    free_large(a, NULL);
     a->end = a->begin;
+    a->last = NULL;
+    a->requested = 0;
 }
 
 void arena_free(Arena *a)
@@ -172,8 +397,40 @@ void arena_free(Arena *a)
         r = r->next;
         free_region(_r);
     }
+    free_large(a, NULL);
     a->begin = NULL;
     a->end = NULL;
+    a->last = NULL;
+    a->requested = 0;
+}
+
+Arena_Mark arena_mark(Arena *a)
+{
+    return (Arena_Mark){
+        .region = a->end,
+        .size = a->end ? a->end->size : 0,
+        .large = a->large,
+        .requested = a->requested,
+    };
+}
+
+void arena_rewind(Arena *a, Arena_Mark mark)
+{
+    free_large(a, mark.large);
+    // Regions after the marked one were empty then, see Arena
+    Region *r = a->begin;
+    if (mark.region != NULL)
+    {
+        mark.region->size = mark.size;
+        r = mark.region->next;
+    }
+    for (; r != NULL; r = r->next)
+    {
+        r->size = 0;
+    }
+    a->end = mark.region ? mark.region : a->begin;
+    a->last = NULL;
+    a->requested = mark.requested;
 }
 
 // End Arena
@@ -199,6 +456,7 @@ static void insert_into_hash(CSV *csv, String_View *key, s32 index)
    new_entry->index = index;
    new_entry->next = indexTable.buckets[h];
    indexTable.buckets[h] = new_entry;
+   csv->hash_entries++;
 }
 
 s32 get_column_index(String_View *key)
@@ -252,281 +510,4444 @@ void init_csv(CSV *csv)
     csv->rows = NULL;
     csv->header = NULL;
     csv->type = NULL;
-    csv->allocator.begin = NULL;
-    csv->allocator.end = NULL;
+    csv->allocator = (Arena){0};
+    csv->scratch = (Arena){0};
+    csv->mapping = NULL;
+    csv->mapping_size = 0;
+    csv->dialect = (CSV_Dialect){0};
+    csv->layout = CSV_LAYOUT_ROWS;
+    csv->columns = NULL;
+    csv->typed = NULL;
+    csv->materialize_types = FALSE;
+    csv->lazy = FALSE;
+    csv->filter = (Row_Filter){0};
+    csv->row_starts = NULL;
+    csv->sampling = (Type_Sampling){0};
+    csv->types_sampled = FALSE;
+    csv->rows_capacity = 0;
+    csv->cols_capacity = 0;
+    csv->type_masks = NULL;
+    csv->source_offset = 0;
+    csv->tail_rows = 0;
+    csv->text_size = 0;
+    csv->hash_entries = 0;
 }
 
 void deinit_csv(CSV *csv)
 {
     arena_free(&csv->allocator);
+    arena_free(&csv->scratch);
+    if (csv->mapping)
+    {
+        munmap(csv->mapping, csv->mapping_size);
+        csv->mapping = NULL;
+        csv->mapping_size = 0;
+    }
+    csv->text_size = 0;
+    csv->hash_entries = 0;
+}
+
+static String_View *split_lazy_row(CSV *csv, u64 row);
+
+/*
+ * Cells of a data row in CSV_LAYOUT_ROWS, split first if the csv was loaded
+ * lazily and the row was never accessed.
+ * @return: The cells, NULL if the arena ran out of memory.
+ */
+static inline String_View *row_cells(CSV *csv, u64 row)
+{
+    String_View *cells = csv->rows[row].cells;
+    return cells ? cells : split_lazy_row(csv, row);
 }
 
-static u64 count_rows_from_buffer(u8 *buffer)
+/*
+ * Cell of a data row (0 is the first row after the header) in either layout.
+ */
+static inline String_View *cell_at(CSV *csv, u64 row, u64 col)
 {
-    u64 rows = 0;
-    u8 *ptr = buffer;
-    while ((ptr = strchr(ptr, '\n')))
+    static String_View empty = {0};
+    if (csv->layout == CSV_LAYOUT_COLUMNS)
     {
-        rows++;
-        ptr++;
+        return &csv->columns[col][row + 1];
     }
-    return rows + 1;
+    String_View *cells = row_cells(csv, row);
+    return cells ? &cells[col] : &empty;
+}
+
+// Begin Type Inference
+
+enum {
+    CHAR_DIGIT = 1,
+    CHAR_DOT = 2,
+    CHAR_OTHER = 4
+};
+
+#define D CHAR_DIGIT
+#define P CHAR_DOT
+#define O CHAR_OTHER
+static const u8 char_class[256] = {
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, P, O,
+    D, D, D, D, D, D, D, D, D, D, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+};
+#undef D
+#undef P
+#undef O
+
+// Types a cell is compatible with, a column keeps the AND of its cells
+enum {
+    TYPE_MASK_INTEGER = 1,
+    TYPE_MASK_FLOAT = 2,
+    TYPE_MASK_BOOLEAN = 4,
+    TYPE_MASK_ALL = 7
+};
+
+static boolean is_bool(String_View data)
+{
+    return (data.size == 4 && (!strncmp(data.data, "TRUE", 4) || !strncmp(data.data, "true", 4))) ||
+           (data.size == 5 && (!strncmp(data.data, "FALSE", 5) || !strncmp(data.data, "false", 5)));
 }
 
-static u64 count_columns_from_buffer(u8 *buffer)
+static inline u8 classify_cell(String_View cell)
 {
-    u64 cols = 0;
-    u8 *ptr = buffer;
-    while (*ptr && (*ptr == '\n' || *ptr == '\r'))
+    if (cell.size == 0 || cell.data == NULL)
     {
-        ptr++;
+        return TYPE_MASK_ALL;
     }
 
-    while (*ptr && *ptr != '\n')
+    u8 mask = is_bool(cell) ? TYPE_MASK_BOOLEAN : 0;
+    const u8 *p = cell.data;
+    const u8 *end = cell.data + cell.size;
+    if (*p == '-')
     {
-        if (*ptr == ';' || *ptr == ',')
-        {
-            cols++;
-        }
-        ptr++;
+        p++;
+    }
+    if (p == end || *p == '.')
+    {
+        return mask;
+    }
+
+    u8 seen = 0;
+    u32 dots = 0;
+    for (; p < end; p++)
+    {
+        u8 class = char_class[*p];
+        seen |= class;
+        dots += class == CHAR_DOT;
     }
-    return cols + 1;
+
+    if (seen == CHAR_DIGIT)
+    {
+        mask |= TYPE_MASK_INTEGER | TYPE_MASK_FLOAT;
+    }
+    else if (!(seen & CHAR_OTHER) && dots == 1)
+    {
+        mask |= TYPE_MASK_FLOAT;
+    }
+    return mask;
 }
 
-static s32 parse_header(CSV *csv, u8 *buffer)
+static ColumnType type_from_mask(u8 mask)
 {
-    csv->header = (String_View *)arena_alloc(&csv->allocator, sizeof(String_View) * csv->cols_count);
-    if (!csv->header)
+    if (mask & TYPE_MASK_INTEGER)
     {
-        set_error(ERR_MEM_ALLOC);
-        return 0;
+        return CSV_TYPE_INTEGER;
     }
-    for (size_t i = 0; i < csv->cols_count; i++)
+    if (mask & TYPE_MASK_BOOLEAN)
     {
-        csv->header[i].data = NULL;
+        return CSV_TYPE_BOOLEAN;
     }
+    if (mask & TYPE_MASK_FLOAT)
+    {
+        return CSV_TYPE_FLOAT;
+    }
+    return CSV_TYPE_STRING;
+}
 
-    u8 *current = buffer;
-    u64 col = 0;
-    while (*current && col < csv->cols_count)
+static void detect_column_type(CSV *csv, u32 col)
+{
+    u8 mask = TYPE_MASK_ALL;
+    for (size_t row = 0; row < csv->rows_count - 1; row++)
     {
-        csv->header[col].data = current;
-        u8 *start = current;
-        while (*current && *current != ';' && *current != ',' && *current != '\n')
-        {
-            current++;
-        }
-        csv->header[col].size = current - start;
-        trim(&csv->header[col]);
-        insert_into_hash(csv, &csv->header[col], col);
-        if (*current == ';' || *current == ',')
-        {
-            current++;
-        } 
-        col++;
+        mask &= classify_cell(*cell_at(csv, row, col));
     }
-    return 1;
+    csv->type[col] = type_from_mask(mask);
 }
 
+// End Type Inference
+
+// Begin Scanner
+
+typedef struct Block_Masks {
+    u64 delimiter;
+    u64 newline;
+    u64 quote;
+} Block_Masks;
 
-static s32 parse(CSV *csv, u8 *buffer)
+typedef void (*Scan_Block_Fn)(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks);
+
+/*
+ * Each kernel is written once against a delimiter and quote argument and
+ * always inlined, so the wrappers generated by DEFINE_SCAN_KERNELS get the
+ * characters of the common dialects folded in as constants. A quote of 0
+ * disables quoting.
+ */
+static inline __attribute__((always_inline))
+void scan_block_scalar_impl(const u8 *block, u8 delimiter, u8 quote, Block_Masks *masks)
 {
-    csv->rows = (Row *)arena_alloc(&csv->allocator, sizeof(Row) * (csv->rows_count - 1));
-    if (!csv->rows)
+    u64 delimiter_mask = 0, newline = 0, quote_mask = 0;
+    for (u32 i = 0; i < SCAN_BLOCK_SIZE; i++)
     {
-        set_error(ERR_MEM_ALLOC);
-        return 0;
+        delimiter_mask |= (u64)(block[i] == delimiter) << i;
+        newline |= (u64)(block[i] == '\n') << i;
+        quote_mask |= (u64)(quote && block[i] == quote) << i;
     }
-    
-    u8 *current = buffer;
-    for (s64 row = 0; row < csv->rows_count - 1; row++)
-    {   
-        csv->rows[row].cells = (String_View *)arena_alloc(&csv->allocator, sizeof(String_View) * csv->cols_count);
-        if (!csv->rows[row].cells)
-        {
-            set_error(ERR_MEM_ALLOC);
-            return 0;
-        }
-        for (size_t i = 0; i < csv->cols_count; i++)
-        {
-            csv->rows[row].cells[i].data = NULL;
-        }
+    masks->delimiter = delimiter_mask;
+    masks->newline = newline;
+    masks->quote = quote_mask;
+}
 
-        u64 col = 0;
-        while (*current && col < csv->cols_count)
-        {
-            csv->rows[row].cells[col].data = current;
-            u8 *start = current;
-            while (*current && *current != ';' && *current != ',' && *current != '\n')
-            {
-                current++;
-            }
-            csv->rows[row].cells[col].size = current - start;
-            trim(&csv->rows[row].cells[col]);   
-            if (*current == ';' || *current == ',')
-            {
-                current++;
-            }
-            col++;
-        }
+#if defined(__x86_64__) || defined(__i386__)
 
-        if (*current == '\0')
+static inline __attribute__((always_inline))
+void scan_block_sse2_impl(const u8 *block, u8 delimiter, u8 quote, Block_Masks *masks)
+{
+    const __m128i delimiter_v = _mm_set1_epi8(delimiter);
+    const __m128i newline_v = _mm_set1_epi8('\n');
+    const __m128i quote_v = _mm_set1_epi8(quote);
+    masks->delimiter = 0;
+    masks->newline = 0;
+    masks->quote = 0;
+    for (u32 i = 0; i < SCAN_BLOCK_SIZE; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(block + i));
+        masks->delimiter |= (u64)(u16)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, delimiter_v)) << i;
+        masks->newline |= (u64)(u16)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline_v)) << i;
+        if (quote)
         {
-            break;
+            masks->quote |= (u64)(u16)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote_v)) << i;
         }
+    }
+}
 
-        if (*current == '\n')
+static inline __attribute__((always_inline, target("avx2")))
+void scan_block_avx2_impl(const u8 *block, u8 delimiter, u8 quote, Block_Masks *masks)
+{
+    const __m256i delimiter_v = _mm256_set1_epi8(delimiter);
+    const __m256i newline_v = _mm256_set1_epi8('\n');
+    const __m256i quote_v = _mm256_set1_epi8(quote);
+    masks->delimiter = 0;
+    masks->newline = 0;
+    masks->quote = 0;
+    for (u32 i = 0; i < SCAN_BLOCK_SIZE; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(block + i));
+        masks->delimiter |= (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, delimiter_v)) << i;
+        masks->newline |= (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline_v)) << i;
+        if (quote)
         {
-            current++;
+            masks->quote |= (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote_v)) << i;
         }
     }
-    return 1;
 }
 
+static inline __attribute__((always_inline, target("avx512bw")))
+void scan_block_avx512_impl(const u8 *block, u8 delimiter, u8 quote, Block_Masks *masks)
+{
+    __m512i chunk = _mm512_loadu_si512((const void *)block);
+    masks->delimiter = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(delimiter));
+    masks->newline = _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8('\n'));
+    masks->quote = quote ? _mm512_cmpeq_epi8_mask(chunk, _mm512_set1_epi8(quote)) : 0;
+}
 
+#define DEFINE_SCAN_KERNELS(name, DELIMITER, QUOTE)                                                          \
+    static void scan_block_scalar_##name(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks)     \
+    {                                                                                                        \
+        (void)dialect;                                                                                       \
+        scan_block_scalar_impl(block, DELIMITER, QUOTE, masks);                                              \
+    }                                                                                                        \
+    static void scan_block_sse2_##name(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks)       \
+    {                                                                                                        \
+        (void)dialect;                                                                                       \
+        scan_block_sse2_impl(block, DELIMITER, QUOTE, masks);                                                \
+    }                                                                                                        \
+    __attribute__((target("avx2")))                                                                          \
+    static void scan_block_avx2_##name(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks)       \
+    {                                                                                                        \
+        (void)dialect;                                                                                       \
+        scan_block_avx2_impl(block, DELIMITER, QUOTE, masks);                                                \
+    }                                                                                                        \
+    __attribute__((target("avx512bw")))                                                                      \
+    static void scan_block_avx512_##name(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks)     \
+    {                                                                                                        \
+        (void)dialect;                                                                                       \
+        scan_block_avx512_impl(block, DELIMITER, QUOTE, masks);                                              \
+    }
 
-static boolean is_bool(String_View data)
+#define SCAN_KERNELS(name, DELIMITER, QUOTE) \
+    { DELIMITER, QUOTE, { scan_block_scalar_##name, scan_block_sse2_##name, scan_block_avx2_##name, scan_block_avx512_##name } }
+
+#else
+
+#define DEFINE_SCAN_KERNELS(name, DELIMITER, QUOTE)                                                          \
+    static void scan_block_scalar_##name(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks)     \
+    {                                                                                                        \
+        (void)dialect;                                                                                       \
+        scan_block_scalar_impl(block, DELIMITER, QUOTE, masks);                                              \
+    }
+
+#define SCAN_KERNELS(name, DELIMITER, QUOTE) \
+    { DELIMITER, QUOTE, { scan_block_scalar_##name, scan_block_scalar_##name, scan_block_scalar_##name, scan_block_scalar_##name } }
+
+#endif
+
+DEFINE_SCAN_KERNELS(comma, ',', '"')
+DEFINE_SCAN_KERNELS(semicolon, ';', '"')
+DEFINE_SCAN_KERNELS(tab, '\t', '"')
+DEFINE_SCAN_KERNELS(pipe, '|', '"')
+
+// Any other dialect reads its characters at runtime
+#if defined(__x86_64__) || defined(__i386__)
+
+static void scan_block_sse2_generic(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks)
 {
-    return (data.size == 4 && (!strncmp(data.data, "TRUE", 4) || !strncmp(data.data, "true", 4))) ||
-           (data.size == 5 && (!strncmp(data.data, "FALSE", 5) || !strncmp(data.data, "false", 5)));
+    scan_block_sse2_impl(block, dialect->delimiter, dialect->quote, masks);
 }
 
-static void detect_column_type(CSV *csv, u32 col)
+__attribute__((target("avx2")))
+static void scan_block_avx2_generic(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks)
 {
-    boolean is_integer = TRUE, is_float = FALSE, is_boolean = TRUE;
-
-    for (size_t row = 0; row < csv->rows_count - 1; row++)
-    {
-        String_View data = csv->rows[row].cells[col];
-        if (data.size == 0 || data.data == NULL)
-        {
-            continue;
-        }
+    scan_block_avx2_impl(block, dialect->delimiter, dialect->quote, masks);
+}
 
-        if (!is_bool(data))
-        {
-            is_boolean = FALSE;
-        }
+__attribute__((target("avx512bw")))
+static void scan_block_avx512_generic(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks)
+{
+    scan_block_avx512_impl(block, dialect->delimiter, dialect->quote, masks);
+}
 
-        boolean has_dot = FALSE;
-        boolean neg = FALSE;
-        for (size_t c = 0; c < data.size; c++)
-        {
-            char ch = data.data[c];
+#else
 
-            if (!isdigit(ch))
-            {
-                if (ch == '-' && c + 1 < data.size && isdigit(data.data[c + 1]))
-                {
-                    neg = TRUE;
-                }
-                else if (ch == '.' && !has_dot && c > 0)
-                {
-                    is_float = TRUE;
-                    has_dot = TRUE;
-                    is_integer = FALSE;
-                }
-                else
-                {
-                    is_integer = FALSE;
-                    is_float = FALSE;
-                    break;
-                }
-            }
-        }
-    }
+static void scan_block_scalar_generic(const u8 *block, const CSV_Dialect *dialect, Block_Masks *masks)
+{
+    scan_block_scalar_impl(block, dialect->delimiter, dialect->quote, masks);
+}
 
-    if (is_integer)
+#endif
+
+typedef enum {
+    ISA_SCALAR = 0,
+    ISA_SSE2,
+    ISA_AVX2,
+    ISA_AVX512,
+    ISA_COUNT
+} Isa_Level;
+
+typedef struct Scan_Kernels {
+    u8 delimiter;
+    u8 quote;
+    Scan_Block_Fn fn[ISA_COUNT];
+} Scan_Kernels;
+
+static const Scan_Kernels scan_kernels[] = {
+    SCAN_KERNELS(comma, ',', '"'),
+    SCAN_KERNELS(semicolon, ';', '"'),
+    SCAN_KERNELS(tab, '\t', '"'),
+    SCAN_KERNELS(pipe, '|', '"'),
+};
+
+static Isa_Level detect_isa()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw"))
     {
-        csv->type[col] = CSV_TYPE_INTEGER;
+        return ISA_AVX512;
     }
-    else if (is_boolean)
+    if (__builtin_cpu_supports("avx2"))
     {
-        csv->type[col] = CSV_TYPE_BOOLEAN;
+        return ISA_AVX2;
     }
-    else if (is_float)
+    return ISA_SSE2;
+#else
+    return ISA_SCALAR;
+#endif
+}
+
+// Detected once, the first scanner may be on a read_csv_parallel worker
+static Isa_Level isa_level;
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+
+static void init_isa_level()
+{
+    isa_level = detect_isa();
+}
+
+static Scan_Block_Fn select_scan_block(const CSV_Dialect *dialect)
+{
+    pthread_once(&isa_once, init_isa_level);
+    Isa_Level isa = isa_level;
+
+    for (size_t i = 0; i < sizeof(scan_kernels) / sizeof(scan_kernels[0]); i++)
     {
-        csv->type[col] = CSV_TYPE_FLOAT;
+        if (scan_kernels[i].delimiter == dialect->delimiter && scan_kernels[i].quote == dialect->quote)
+        {
+            return scan_kernels[i].fn[isa];
+        }
     }
-    else
+
+#if defined(__x86_64__) || defined(__i386__)
+    switch (isa)
     {
-        csv->type[col] = CSV_TYPE_STRING;
+        case ISA_AVX512:
+            return scan_block_avx512_generic;
+        case ISA_AVX2:
+            return scan_block_avx2_generic;
+        default:
+            return scan_block_sse2_generic;
     }
+#else
+    return scan_block_scalar_generic;
+#endif
 }
 
+/*
+ * Sets every bit from a quote up to (not including) the next one, so
+ * quoted spans come out as runs of ones without a branch per byte.
+ */
+static inline u64 prefix_xor(u64 bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
 
-void read_csv(const char *content, CSV *csv)
+/*
+ * Walks the structural characters (delimiters and newlines outside of
+ * quotes) of [base, end) one 64-byte block at a time. in_quote carries the
+ * quote state from one block to the next. The last partial block is copied
+ * into a zero padded buffer so the vector loads never read past the end.
+ */
+typedef struct Scanner {
+    u8 *base;
+    u8 *end;
+    const CSV_Dialect *dialect;
+    Scan_Block_Fn scan_block;
+    u64 structural;
+    u64 newline;
+    u64 in_quote;
+    u8 tail[SCAN_BLOCK_SIZE];
+} Scanner;
+
+static void scanner_load(Scanner *s)
 {
-    FILE *file = fopen(content, "rb");
-    if (!file)
+    Block_Masks masks;
+    if (s->end - s->base >= SCAN_BLOCK_SIZE)
+    {
+        s->scan_block(s->base, s->dialect, &masks);
+    }
+    else
+    {
+        memset(s->tail, 0, SCAN_BLOCK_SIZE);
+        memcpy(s->tail, s->base, s->end - s->base);
+        s->scan_block(s->tail, s->dialect, &masks);
+    }
+    u64 quoted = prefix_xor(masks.quote) ^ s->in_quote;
+    s->in_quote = (u64)((s64)quoted >> 63);
+    s->structural = (masks.delimiter | masks.newline) & ~quoted;
+    s->newline = masks.newline;
+}
+
+static void scanner_init_at(Scanner *s, u8 *begin, u8 *end, const CSV_Dialect *dialect, boolean in_quote)
+{
+    s->base = begin;
+    s->end = end;
+    s->dialect = dialect;
+    s->scan_block = select_scan_block(dialect);
+    s->structural = 0;
+    s->newline = 0;
+    s->in_quote = in_quote ? ~0ULL : 0;
+    if (begin < end)
+    {
+        scanner_load(s);
+    }
+}
+
+static void scanner_init(Scanner *s, u8 *begin, u8 *end, const CSV_Dialect *dialect)
+{
+    scanner_init_at(s, begin, end, dialect, FALSE);
+}
+
+static u64 count_quotes(u8 *begin, u8 *end, const CSV_Dialect *dialect)
+{
+    Scan_Block_Fn scan_block = select_scan_block(dialect);
+    u64 quotes = 0;
+    Block_Masks masks;
+    for (; end - begin >= SCAN_BLOCK_SIZE; begin += SCAN_BLOCK_SIZE)
+    {
+        scan_block(begin, dialect, &masks);
+        quotes += __builtin_popcountll(masks.quote);
+    }
+    while (begin < end)
+    {
+        quotes += dialect->quote && *begin == dialect->quote;
+        begin++;
+    }
+    return quotes;
+}
+
+/*
+ * Finds the next structural character.
+ * @return boolean: False once the end of the buffer is reached.
+ */
+static inline boolean scanner_next(Scanner *s, u8 **pos, boolean *is_newline)
+{
+    while (s->structural == 0)
+    {
+        s->base += SCAN_BLOCK_SIZE;
+        if (s->base >= s->end)
+        {
+            s->base = s->end;
+            return FALSE;
+        }
+        scanner_load(s);
+    }
+    u32 bit = __builtin_ctzll(s->structural);
+    s->structural &= s->structural - 1;
+    *pos = s->base + bit;
+    *is_newline = (s->newline >> bit) & 1;
+    return TRUE;
+}
+
+/*
+ * Finds the next newline outside of quotes, skipping the delimiters before it.
+ * @return boolean: False once the end of the buffer is reached.
+ */
+static inline boolean scanner_next_record(Scanner *s, u8 **pos)
+{
+    u64 newlines = s->structural & s->newline;
+    while (newlines == 0)
+    {
+        s->base += SCAN_BLOCK_SIZE;
+        if (s->base >= s->end)
+        {
+            s->base = s->end;
+            s->structural = 0;
+            return FALSE;
+        }
+        scanner_load(s);
+        newlines = s->structural & s->newline;
+    }
+    u32 bit = __builtin_ctzll(newlines);
+    s->structural &= ~((2ULL << bit) - 1);
+    *pos = s->base + bit;
+    return TRUE;
+}
+
+// End Scanner
+
+// Begin Dialect
+
+CSV_Dialect sniff_dialect(const u8 *buffer, u64 size)
+{
+    static const u8 candidates[] = { ',', ';', '\t', '|' };
+    enum { CANDIDATES = sizeof(candidates), SNIFF_LINES = 32 };
+
+    CSV_Dialect dialect = { .delimiter = ',', .quote = '"', .crlf = FALSE, .trim = TRUE };
+    if (size > SNIFF_SIZE)
+    {
+        size = SNIFF_SIZE;
+    }
+
+    u32 counts[SNIFF_LINES][CANDIDATES] = {0};
+    u32 lines = 0;
+    boolean in_quote = FALSE;
+    for (u64 i = 0; i < size && lines < SNIFF_LINES; i++)
+    {
+        u8 ch = buffer[i];
+        if (ch == '"')
+        {
+            in_quote = !in_quote;
+        }
+        else if (in_quote)
+        {
+            continue;
+        }
+        else if (ch == '\n')
+        {
+            if (lines == 0 && i > 0 && buffer[i - 1] == '\r')
+            {
+                dialect.crlf = TRUE;
+            }
+            lines++;
+        }
+        else
+        {
+            for (u32 c = 0; c < CANDIDATES; c++)
+            {
+                counts[lines][c] += ch == candidates[c];
+            }
+        }
+    }
+    // A line cut by the sample size is only counted when it is the only one
+    if (lines == 0)
+    {
+        lines = 1;
+    }
+
+    // The delimiter is the candidate found on most lines with the same count as the header
+    u32 best_lines = 0, best_count = 0;
+    for (u32 c = 0; c < CANDIDATES; c++)
+    {
+        u32 header_count = counts[0][c];
+        if (header_count == 0)
+        {
+            continue;
+        }
+
+        u32 matching = 0;
+        for (u32 line = 0; line < lines; line++)
+        {
+            matching += counts[line][c] == header_count;
+        }
+
+        if (matching > best_lines || (matching == best_lines && header_count > best_count))
+        {
+            best_lines = matching;
+            best_count = header_count;
+            dialect.delimiter = candidates[c];
+        }
+    }
+    return dialect;
+}
+
+// End Dialect
+
+/*
+ * Strips the surrounding quotes of a field and, only when the field holds
+ * escaped quotes (""), copies it into the arena with them collapsed.
+ * @return s32: 0 if the arena ran out of memory.
+ */
+static s32 unquote(Arena *arena, String_View *cell, u8 quote)
+{
+    if (cell->size < 2 || cell->data[0] != quote || cell->data[cell->size - 1] != quote)
+    {
+        return 1;
+    }
+    cell->data++;
+    cell->size -= 2;
+
+    u8 *escape = memchr(cell->data, quote, cell->size);
+    if (!escape)
+    {
+        return 1;
+    }
+
+    u8 *unescaped = arena_alloc(arena, cell->size);
+    if (!unescaped)
+    {
+        return 0;
+    }
+    u64 size = escape - cell->data;
+    memcpy(unescaped, cell->data, size);
+    for (u64 i = size; i < cell->size; i++)
+    {
+        unescaped[size++] = cell->data[i];
+        if (cell->data[i] == quote && i + 1 < cell->size && cell->data[i + 1] == quote)
+        {
+            i++;
+        }
+    }
+    cell->data = unescaped;
+    cell->size = size;
+    return 1;
+}
+
+/*
+ * Applies the dialect to a raw field: drops the '\r' of a CRLF line ending,
+ * trims and unquotes.
+ * @return s32: 0 if the arena ran out of memory.
+ */
+static inline s32 finish_field(Arena *arena, const CSV_Dialect *dialect, String_View *cell, boolean is_newline)
+{
+    if (dialect->crlf && is_newline && cell->size && cell->data[cell->size - 1] == '\r')
+    {
+        cell->size--;
+    }
+    if (dialect->trim)
+    {
+        trim(cell);
+    }
+    if (dialect->quote && cell->size && cell->data[0] == dialect->quote)
+    {
+        return unquote(arena, cell, dialect->quote);
+    }
+    return 1;
+}
+
+/*
+ * Splits one record starting at current into cells, at most cols cells are kept.
+ * @return: Pointer to the first byte of the next record, NULL if the arena ran out of memory.
+ */
+static u8 *split_record(Arena *arena, Scanner *scanner, u8 *current, String_View *cells, u64 cols)
+{
+    u64 col = 0;
+    u8 *pos;
+    boolean is_newline = FALSE;
+    while (TRUE)
+    {
+        if (!scanner_next(scanner, &pos, &is_newline))
+        {
+            pos = scanner->end;
+            is_newline = TRUE;
+        }
+
+        if (col < cols)
+        {
+            cells[col].data = current;
+            cells[col].size = pos - current;
+            if (!finish_field(arena, scanner->dialect, &cells[col], is_newline))
+            {
+                return NULL;
+            }
+        }
+        col++;
+        current = pos + 1;
+
+        if (is_newline)
+        {
+            return current;
+        }
+    }
+}
+
+static s32 parse_header(CSV *csv, Scanner *scanner, u8 **buffer)
+{
+    u64 capacity = HEADER_INITIAL_CAPACITY;
+    csv->header = (String_View *)arena_alloc(&csv->allocator, sizeof(String_View) * capacity);
+    if (!csv->header)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+
+    u8 *current = *buffer;
+    u8 *pos;
+    boolean is_newline = FALSE;
+    csv->cols_count = 0;
+    while (!is_newline)
+    {
+        if (!scanner_next(scanner, &pos, &is_newline))
+        {
+            pos = scanner->end;
+            is_newline = TRUE;
+        }
+
+        if (csv->cols_count == capacity)
+        {
+            csv->header = arena_realloc(&csv->allocator, csv->header, sizeof(String_View) * capacity, sizeof(String_View) * capacity * 2);
+            if (!csv->header)
+            {
+                set_error(ERR_MEM_ALLOC);
+                return 0;
+            }
+            capacity *= 2;
+        }
+
+        String_View *cell = &csv->header[csv->cols_count];
+        cell->data = current;
+        cell->size = pos - current;
+        if (!finish_field(&csv->allocator, scanner->dialect, cell, is_newline))
+        {
+            set_error(ERR_MEM_ALLOC);
+            return 0;
+        }
+        insert_into_hash(csv, cell, csv->cols_count);
+        csv->cols_count++;
+        current = pos + 1;
+    }
+    *buffer = current;
+    return 1;
+}
+
+/*
+ * Rows produced by parse_rows in either layout. Column arrays keep slot 0
+ * free for the header.
+ */
+typedef struct Parsed_Rows {
+    CSV_Layout layout;
+    u64 cols_count;
+    u64 max_rows;         // stop after this many rows, 0 for no limit
+    boolean partial_tail; // the buffer may end in the middle of a record
+    Row *rows;
+    String_View **columns;
+    String_View *scratch;
+    u64 count;
+    u64 capacity;
+    u8 *type_masks; // per column, AND of the classified cells
+    Type_Sampling sampling;
+    u64 rng;
+    const s32 *projection;    // kept column of every field, NULL keeps them all
+    u64 last_col;             // fields after this one are skipped
+    const Row_Filter *filter; // NULL keeps every row
+    u64 filter_col;           // field the filter looks at
+    u8 *last_record;          // start of the last record split
+    boolean last_kept;        // whether it passed the filter
+    boolean tail_apart;       // classify a last record without newline into tail_masks
+    u8 *tail_masks;           // as it may be cut off, csv_refresh leaves it out of csv->type_masks
+    String_View *slab;        // cell arrays of the next rows, CSV_LAYOUT_ROWS
+    u64 slab_left;            // rows left in slab
+} Parsed_Rows;
+
+static boolean row_filter_match(const Row_Filter *filter, String_View cell)
+{
+    if (filter->op == FILTER_PREDICATE)
+    {
+        return filter->predicate(cell);
+    }
+    // Only cells that would type as numbers compare, to_float reads others as 0
+    if (is_cell_empty(cell) || !(classify_cell(cell) & TYPE_MASK_FLOAT))
+    {
+        return FALSE;
+    }
+
+    double value = to_float(cell);
+    switch (filter->op)
+    {
+        case FILTER_LT:
+            return value < filter->value;
+        case FILTER_LE:
+            return value <= filter->value;
+        case FILTER_EQ:
+            return value == filter->value;
+        case FILTER_NE:
+            return value != filter->value;
+        case FILTER_GE:
+            return value >= filter->value;
+        case FILTER_GT:
+            return value > filter->value;
+        default:
+            return TRUE;
+    }
+}
+
+/*
+ * Like split_record, but stores field col in cells[out->projection[col]],
+ * dropping the fields whose projection is -1, and checks out->filter as soon
+ * as its field is split. The rest of the record is skipped, without looking
+ * at its delimiters, after out->last_col or once the filter fails.
+ * @return: Pointer to the first byte of the next record, NULL if the arena ran out of memory.
+ */
+static u8 *split_record_filtered(Arena *arena, Scanner *scanner, u8 *current, String_View *cells, const Parsed_Rows *out, boolean *keep)
+{
+    u64 col = 0;
+    u8 *pos;
+    boolean is_newline = FALSE;
+    *keep = TRUE;
+    while (TRUE)
+    {
+        if (col > out->last_col || !*keep)
+        {
+            return scanner_next_record(scanner, &pos) ? pos + 1 : scanner->end + 1;
+        }
+        if (!scanner_next(scanner, &pos, &is_newline))
+        {
+            pos = scanner->end;
+            is_newline = TRUE;
+        }
+
+        s64 target = out->projection ? out->projection[col] : (col < out->cols_count ? (s64)col : -1);
+        boolean filtered = out->filter && col == out->filter_col;
+        if (target >= 0 || filtered)
+        {
+            String_View cell = { .data = current, .size = pos - current };
+            if (!finish_field(arena, scanner->dialect, &cell, is_newline))
+            {
+                return NULL;
+            }
+            if (target >= 0)
+            {
+                cells[target] = cell;
+            }
+            if (filtered)
+            {
+                *keep = row_filter_match(out->filter, cell);
+            }
+        }
+        col++;
+        current = pos + 1;
+
+        if (is_newline)
+        {
+            if (out->filter && out->filter_col >= col)
+            {
+                // The record is too short to hold the filtered field
+                *keep = row_filter_match(out->filter, (String_View){0});
+            }
+            return current;
+        }
+    }
+}
+
+/*
+ * Fills the Parsed_Rows settings that come from csv, resolving the filter's
+ * column against the header.
+ * @return s32: 0 if the filter's column does not exist.
+ */
+static s32 parsed_rows_config(CSV *csv, Parsed_Rows *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->layout = csv->layout;
+    out->cols_count = csv->cols_count;
+    out->sampling = csv->sampling;
+    out->last_col = UINT64_MAX;
+    if (csv->filter.op != FILTER_NONE)
+    {
+        s32 col = get_column_index(&csv->filter.column);
+        if (col == -1 || (csv->filter.op == FILTER_PREDICATE && !csv->filter.predicate))
+        {
+            set_error(col == -1 ? ERR_COLUMN_NOT_FOUND : ERR_INVALID_ARG);
+            return 0;
+        }
+        out->filter = &csv->filter;
+        out->filter_col = col;
+    }
+    return 1;
+}
+
+// Whether the row about to be added is classified for type inference
+static inline boolean sample_row(Parsed_Rows *out)
+{
+    if (out->sampling.head_rows == 0 || out->count < out->sampling.head_rows)
+    {
+        return TRUE;
+    }
+    if (out->sampling.one_in == 0)
+    {
+        return FALSE;
+    }
+    out->rng ^= out->rng << 13;
+    out->rng ^= out->rng >> 7;
+    out->rng ^= out->rng << 17;
+    return out->rng % out->sampling.one_in == 0;
+}
+
+/*
+ * Allocates the empty row table (or column arrays) and the type masks.
+ * @return s32: 1 on success, 0 if the arena ran out of memory.
+ */
+static s32 parsed_rows_init(Arena *arena, Parsed_Rows *out)
+{
+    u64 cols_count = out->cols_count;
+    out->capacity = ROWS_INITIAL_CAPACITY;
+    out->count = 0;
+    out->rows = NULL;
+    out->columns = NULL;
+    out->scratch = NULL;
+    out->slab = NULL;
+    out->slab_left = 0;
+    out->rng = out->rng ? out->rng : 0x9E3779B97F4A7C15ULL;
+    out->type_masks = (u8 *)arena_alloc(arena, cols_count);
+    if (!out->type_masks)
+    {
+        return 0;
+    }
+    memset(out->type_masks, TYPE_MASK_ALL, cols_count);
+
+    if (out->tail_apart)
+    {
+        out->tail_masks = (u8 *)arena_alloc(arena, cols_count);
+        if (!out->tail_masks)
+        {
+            return 0;
+        }
+        memset(out->tail_masks, TYPE_MASK_ALL, cols_count);
+    }
+
+    if (out->layout == CSV_LAYOUT_COLUMNS || out->filter)
+    {
+        // Rows are split here first, and only copied to the table once kept
+        out->scratch = (String_View *)arena_alloc(arena, sizeof(String_View) * cols_count);
+        if (!out->scratch)
+        {
+            return 0;
+        }
+    }
+
+    if (out->layout == CSV_LAYOUT_COLUMNS)
+    {
+        out->columns = (String_View **)arena_alloc(arena, sizeof(String_View *) * cols_count);
+        if (!out->columns)
+        {
+            return 0;
+        }
+        for (u64 col = 0; col < cols_count; col++)
+        {
+            // Slot 0 is kept for the header so get_column can hand the array out as is
+            out->columns[col] = (String_View *)arena_alloc(arena, sizeof(String_View) * (out->capacity + 1));
+            if (!out->columns[col])
+            {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    out->rows = (Row *)arena_alloc(arena, sizeof(Row) * out->capacity);
+    return out->rows != NULL;
+}
+
+/*
+ * Cell array for the next row, carved out of a slab holding many rows so a row
+ * costs no allocation of its own. A new slab covers what is left of the
+ * buffer at the rate rows were kept so far. parse_rows takes the array off
+ * the slab only once the row is stored.
+ * @param kept: Rows kept so far by this call of parse_rows
+ * @param consumed: Bytes it went through to keep them
+ * @param left: Bytes left in its buffer
+ */
+static String_View *slab_cells(Arena *arena, Parsed_Rows *out, u64 kept, u64 consumed, u64 left)
+{
+    if (out->slab_left == 0)
+    {
+        u64 rows = SLAB_MIN_ROWS;
+        if (kept > 0)
+        {
+            rows += (u64)((double)left * kept / consumed);
+        }
+        if (out->max_rows != 0 && rows > out->max_rows - out->count)
+        {
+            rows = out->max_rows - out->count;
+        }
+        out->slab = (String_View *)arena_alloc(arena, sizeof(String_View) * out->cols_count * rows);
+        if (!out->slab)
+        {
+            return NULL;
+        }
+        out->slab_left = rows;
+    }
+    return out->slab;
+}
+
+/*
+ * Splits records from buffer on in a single pass over the scanner, appending
+ * them to out and growing its tables geometrically. Stops at the end of the
+ * scanner, after out->max_rows rows, or, with out->partial_tail, before a
+ * record cut by the end of the buffer. Touches no global state so it can run
+ * on worker threads.
+ * @return: Where parsing stopped, NULL if the arena ran out of memory.
+ */
+static u8 *parse_rows(Arena *arena, Scanner *scanner, u8 *buffer, Parsed_Rows *out)
+{
+    u64 cols_count = out->cols_count;
+    u64 first_row = out->count;
+    u8 *current = buffer;
+    while (current < scanner->end && (out->max_rows == 0 || out->count < out->max_rows))
+    {   
+        if (out->count == out->capacity)
+        {
+            // Only the last table can grow in place and the others leave a
+            // stale copy behind, so size them for what is left of the buffer
+            // at the rate rows were kept so far, as slab_cells does
+            u64 capacity = out->capacity;
+            u64 grown = capacity * 2;
+            u64 kept = out->count - first_row;
+            if (kept > 0)
+            {
+                u64 estimate = out->count + SLAB_MIN_ROWS + (u64)((double)(scanner->end - current) * kept / (current - buffer));
+                grown = capacity + capacity / 4;
+                grown = estimate > grown ? estimate : grown;
+            }
+            if (out->max_rows != 0 && grown > out->max_rows)
+            {
+                grown = out->max_rows;
+            }
+
+            if (out->layout == CSV_LAYOUT_COLUMNS)
+            {
+                for (u64 col = 0; col < cols_count; col++)
+                {
+                    out->columns[col] = arena_realloc(arena, out->columns[col], sizeof(String_View) * (capacity + 1), sizeof(String_View) * (grown + 1));
+                    if (!out->columns[col])
+                    {
+                        return NULL;
+                    }
+                }
+            }
+            else
+            {
+                out->rows = (Row *)arena_realloc(arena, out->rows, sizeof(Row) * capacity, sizeof(Row) * grown);
+                if (!out->rows)
+                {
+                    return NULL;
+                }
+            }
+            out->capacity = grown;
+        }
+
+        String_View *cells = out->scratch;
+        if (!cells)
+        {
+            cells = slab_cells(arena, out, out->count - first_row, current - buffer, scanner->end - current);
+            if (!cells)
+            {
+                return NULL;
+            }
+        }
+        for (size_t i = 0; i < cols_count; i++)
+        {
+            cells[i].data = NULL;
+            cells[i].size = 0;
+        }
+
+        boolean keep = TRUE;
+        u8 *next = out->projection || out->filter ? split_record_filtered(arena, scanner, current, cells, out, &keep)
+                                                  : split_record(arena, scanner, current, cells, cols_count);
+        if (!next)
+        {
+            return NULL;
+        }
+        if (out->partial_tail && next > scanner->end)
+        {
+            // No newline before the end of the buffer, the record is incomplete
+            break;
+        }
+        out->last_record = current;
+        out->last_kept = keep;
+        current = next;
+        if (!keep)
+        {
+            continue;
+        }
+
+        if (out->layout == CSV_LAYOUT_ROWS && out->scratch)
+        {
+            cells = slab_cells(arena, out, out->count - first_row, current - buffer, scanner->end - current);
+            if (!cells)
+            {
+                return NULL;
+            }
+            memcpy(cells, out->scratch, sizeof(String_View) * cols_count);
+        }
+
+        if (sample_row(out))
+        {
+            u8 *masks = out->tail_apart && current > scanner->end ? out->tail_masks : out->type_masks;
+            for (u64 col = 0; col < cols_count; col++)
+            {
+                masks[col] &= classify_cell(cells[col]);
+            }
+        }
+
+        if (out->layout == CSV_LAYOUT_COLUMNS)
+        {
+            for (u64 col = 0; col < cols_count; col++)
+            {
+                out->columns[col][out->count + 1] = cells[col];
+            }
+        }
+        else
+        {
+            out->rows[out->count].cells = cells;
+            out->slab += cols_count;
+            out->slab_left--;
+        }
+        out->count++;
+    }
+    return current;
+}
+
+/*
+ * Sets the column types from the masks of the parsed rows.
+ * @param tail_masks: Masks of a last row without newline, may be NULL
+ */
+static s32 set_types_from_masks(CSV *csv, const u8 *type_masks, const u8 *tail_masks)
+{
+    csv->type = (ColumnType *)arena_alloc(&csv->allocator, sizeof(ColumnType) * csv->cols_count);
+    if (!csv->type)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+
+    // Kept so csv_refresh can promote types with the rows it adds
+    csv->type_masks = (u8 *)arena_alloc(&csv->allocator, csv->cols_count);
+    if (!csv->type_masks)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+    memcpy(csv->type_masks, type_masks, csv->cols_count);
+
+    for (u64 col = 0; col < csv->cols_count; col++)
+    {
+        csv->type[col] = type_from_mask(type_masks[col] & (tail_masks ? tail_masks[col] : TYPE_MASK_ALL));
+    }
+    csv->types_sampled = csv->sampling.head_rows != 0;
+    return 1;
+}
+
+static s32 store_parsed(CSV *csv, const Parsed_Rows *parsed)
+{
+    csv->rows = parsed->rows;
+    csv->columns = parsed->columns;
+    csv->rows_count = parsed->count + 1; // for header
+    csv->rows_capacity = parsed->capacity;
+    return set_types_from_masks(csv, parsed->type_masks, parsed->tail_masks);
+}
+
+/*
+ * Last record of a parse. csv_refresh parses it again when it had no newline,
+ * since the file may have been read while it was being written.
+ */
+typedef struct Parse_Tail {
+    u8 *record;
+    boolean kept;
+} Parse_Tail;
+
+static s32 parse(CSV *csv, Scanner *scanner, u8 *buffer, Parse_Tail *tail)
+{
+    Parsed_Rows parsed;
+    if (!parsed_rows_config(csv, &parsed))
+    {
+        return 0;
+    }
+    parsed.tail_apart = TRUE;
+    if (!parsed_rows_init(&csv->allocator, &parsed) || !parse_rows(&csv->allocator, scanner, buffer, &parsed))
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+    tail->record = parsed.last_record;
+    tail->kept = parsed.last_kept;
+    return store_parsed(csv, &parsed);
+}
+
+/*
+ * Runs fn once per item, each on its own thread, and waits for all of them.
+ * Items that could not get a thread run on the calling one.
+ */
+static void run_workers(void *(*fn)(void *), void *items, size_t item_size, u32 count)
+{
+    pthread_t *workers = calloc(count, sizeof(pthread_t));
+    u32 started = 0;
+    for (; workers && started < count; started++)
+    {
+        if (pthread_create(&workers[started], NULL, fn, (u8 *)items + item_size * started) != 0)
+        {
+            break;
+        }
+    }
+    for (u32 i = started; i < count; i++)
+    {
+        fn((u8 *)items + item_size * i);
+    }
+    for (u32 i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+}
+
+typedef struct Parse_Chunk {
+    u8 *begin;
+    u8 *end;
+    u64 quotes;
+    const CSV_Dialect *dialect;
+    Arena arena;
+    Parsed_Rows parsed;
+    s32 ok;
+} Parse_Chunk;
+
+static void *count_quotes_worker(void *arg)
+{
+    Parse_Chunk *chunk = arg;
+    chunk->quotes = count_quotes(chunk->begin, chunk->end, chunk->dialect);
+    return NULL;
+}
+
+static void *parse_chunk_worker(void *arg)
+{
+    Parse_Chunk *chunk = arg;
+    Scanner scanner;
+    scanner_init(&scanner, chunk->begin, chunk->end, chunk->dialect);
+    chunk->ok = parsed_rows_init(&chunk->arena, &chunk->parsed) &&
+                parse_rows(&chunk->arena, &scanner, chunk->begin, &chunk->parsed) != NULL;
+    return NULL;
+}
+
+// Moves every region of src to dst, so they are freed along with dst
+static void arena_adopt(Arena *dst, Arena *src)
+{
+    if (src->begin == NULL)
+    {
+        return;
+    }
+
+    if (src->large != NULL)
+    {
+        Region *last = src->large;
+        while (last->next != NULL)
+        {
+            last = last->next;
+        }
+        last->next = dst->large;
+        dst->large = src->large;
+    }
+
+    if (dst->begin == NULL)
+    {
+        dst->begin = src->begin;
+        dst->end = src->end;
+        dst->last = src->last;
+    }
+    else
+    {
+        // In front, as the regions after dst->end must stay empty
+        Region *last = src->begin;
+        while (last->next != NULL)
+        {
+            last = last->next;
+        }
+        last->next = dst->begin;
+        dst->begin = src->begin;
+    }
+    arena_set_requested(dst, dst->requested + src->requested);
+    dst->backing |= src->backing & ARENA_BACKING_FAILED;
+    src->begin = NULL;
+    src->end = NULL;
+    src->last = NULL;
+    src->large = NULL;
+    src->requested = 0;
+}
+
+/*
+ * Splits [buffer, end) into chunks that start right after a newline, parses
+ * each one on its own thread into a private arena and stitches the row
+ * tables back together in order. A first parallel pass counts the quotes of
+ * each nominal chunk, so the quote state at every split point is known and
+ * newlines inside quoted fields are never taken as a record boundary.
+ */
+static s32 parse_parallel(CSV *csv, u8 *buffer, u8 *end, u32 threads, Parse_Tail *tail)
+{
+    u64 length = end - buffer;
+    if (threads > length / PARALLEL_MIN_CHUNK_SIZE)
+    {
+        threads = length / PARALLEL_MIN_CHUNK_SIZE;
+    }
+
+    if (threads <= 1)
+    {
+        Scanner scanner;
+        scanner_init(&scanner, buffer, end, &csv->dialect);
+        return parse(csv, &scanner, buffer, tail);
+    }
+
+    Parsed_Rows config;
+    if (!parsed_rows_config(csv, &config))
+    {
+        return 0;
+    }
+
+    Parse_Chunk *chunks = calloc(threads, sizeof(Parse_Chunk));
+    if (!chunks)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+
+    for (u32 i = 0; i < threads; i++)
+    {
+        chunks[i].begin = buffer + length / threads * i;
+        chunks[i].end = i + 1 < threads ? buffer + length / threads * (i + 1) : end;
+        chunks[i].parsed = config;
+        chunks[i].parsed.rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+        if (i > 0 && csv->sampling.head_rows != 0)
+        {
+            // Only the first chunk holds the head of the file, the others are
+            // sampled from their first row on
+            chunks[i].parsed.sampling.head_rows = 1;
+        }
+        chunks[i].dialect = &csv->dialect;
+        chunks[i].arena.backing = csv->allocator.backing;
+    }
+    chunks[threads - 1].parsed.tail_apart = TRUE;
+    run_workers(count_quotes_worker, chunks, sizeof(Parse_Chunk), threads);
+
+    u64 quotes = 0;
+    for (u32 i = 1; i < threads; i++)
+    {
+        quotes += chunks[i - 1].quotes;
+        if (chunks[i - 1].begin >= chunks[i].begin)
+        {
+            // A quoted field ran over this whole chunk, leave the previous one empty
+            chunks[i].begin = chunks[i - 1].begin;
+            chunks[i - 1].end = chunks[i].begin;
+            continue;
+        }
+
+        Scanner scanner;
+        u8 *pos;
+        boolean is_newline = FALSE;
+        scanner_init_at(&scanner, chunks[i].begin, end, &csv->dialect, quotes & 1);
+        while (!is_newline && scanner_next(&scanner, &pos, &is_newline))
+        {
+        }
+        chunks[i].begin = is_newline ? pos + 1 : end;
+        chunks[i - 1].end = chunks[i].begin;
+    }
+    run_workers(parse_chunk_worker, chunks, sizeof(Parse_Chunk), threads);
+
+    u64 rows_count = 0;
+    s32 ok = 1;
+    for (u32 i = 0; i < threads; i++)
+    {
+        ok &= chunks[i].ok;
+        rows_count += chunks[i].parsed.count;
+    }
+
+    u64 capacity = rows_count ? rows_count : 1;
+    if (ok && csv->layout == CSV_LAYOUT_COLUMNS)
+    {
+        csv->columns = arena_alloc(&csv->allocator, sizeof(String_View *) * csv->cols_count);
+        ok = csv->columns != NULL;
+        for (u64 col = 0; ok && col < csv->cols_count; col++)
+        {
+            csv->columns[col] = arena_alloc(&csv->allocator, sizeof(String_View) * (capacity + 1));
+            ok = csv->columns[col] != NULL;
+        }
+    }
+    else if (ok)
+    {
+        csv->rows = arena_alloc(&csv->allocator, sizeof(Row) * capacity);
+        ok = csv->rows != NULL;
+    }
+
+    u64 row = 0;
+    for (u32 i = 0; i < threads; i++)
+    {
+        Parsed_Rows *parsed = &chunks[i].parsed;
+        if (ok && csv->layout == CSV_LAYOUT_COLUMNS)
+        {
+            for (u64 col = 0; col < csv->cols_count; col++)
+            {
+                memcpy(csv->columns[col] + 1 + row, parsed->columns[col] + 1, sizeof(String_View) * parsed->count);
+            }
+        }
+        else if (ok)
+        {
+            memcpy(csv->rows + row, parsed->rows, sizeof(Row) * parsed->count);
+        }
+        row += parsed->count;
+        if (parsed->last_record)
+        {
+            tail->record = parsed->last_record;
+            tail->kept = parsed->last_kept;
+        }
+        if (ok && i > 0)
+        {
+            for (u64 col = 0; col < csv->cols_count; col++)
+            {
+                chunks[0].parsed.type_masks[col] &= parsed->type_masks[col];
+            }
+        }
+        arena_adopt(&csv->allocator, &chunks[i].arena);
+    }
+    u8 *type_masks = chunks[0].parsed.type_masks;
+    u8 *tail_masks = chunks[threads - 1].parsed.tail_masks;
+    free(chunks);
+
+    if (!ok)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+    csv->rows_count = rows_count + 1; // for header
+    csv->rows_capacity = capacity;
+    return set_types_from_masks(csv, type_masks, tail_masks);
+}
+
+
+
+// Begin Lazy Rows
+
+/*
+ * Records where every row starts, without splitting any field. Rows are split
+ * by row_cells on first access. Types come from the first head_rows rows of
+ * csv->sampling, LAZY_TYPE_ROWS if unset, and are checked on first numeric use.
+ * @return s32: 0 on failure, the error is already set.
+ */
+static s32 parse_lazy(CSV *csv, Scanner *scanner, u8 *buffer)
+{
+    u64 capacity = ROWS_INITIAL_CAPACITY;
+    u8 **starts = arena_alloc(&csv->allocator, sizeof(u8 *) * (capacity + 1));
+    if (!starts)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+
+    u64 count = 0;
+    u8 *current = buffer;
+    while (current < scanner->end)
+    {
+        if (count == capacity)
+        {
+            starts = arena_realloc(&csv->allocator, starts, sizeof(u8 *) * (capacity + 1), sizeof(u8 *) * (capacity * 2 + 1));
+            if (!starts)
+            {
+                set_error(ERR_MEM_ALLOC);
+                return 0;
+            }
+            capacity *= 2;
+        }
+        starts[count++] = current;
+
+        u8 *pos;
+        current = scanner_next_record(scanner, &pos) ? pos + 1 : scanner->end;
+    }
+    starts[count] = scanner->end;
+
+    csv->rows = arena_alloc(&csv->allocator, sizeof(Row) * count);
+    u8 *type_masks = arena_alloc(&csv->allocator, csv->cols_count);
+    if (!csv->rows || !type_masks)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+    memset(csv->rows, 0, sizeof(Row) * count);
+    csv->row_starts = starts;
+    csv->rows_count = count + 1; // for header
+
+    u64 head = csv->sampling.head_rows ? csv->sampling.head_rows : LAZY_TYPE_ROWS;
+    head = head < count ? head : count;
+    memset(type_masks, TYPE_MASK_ALL, csv->cols_count);
+    for (u64 row = 0; row < head; row++)
+    {
+        String_View *cells = row_cells(csv, row);
+        if (!cells)
+        {
+            return 0;
+        }
+        for (u64 col = 0; col < csv->cols_count; col++)
+        {
+            type_masks[col] &= classify_cell(cells[col]);
+        }
+    }
+    if (!set_types_from_masks(csv, type_masks, NULL))
+    {
+        return 0;
+    }
+    csv->types_sampled = head < count;
+    return 1;
+}
+
+static String_View *split_lazy_row(CSV *csv, u64 row)
+{
+    String_View *cells = arena_alloc(&csv->allocator, sizeof(String_View) * csv->cols_count);
+    if (!cells)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return NULL;
+    }
+    for (u64 col = 0; col < csv->cols_count; col++)
+    {
+        cells[col].data = NULL;
+        cells[col].size = 0;
+    }
+
+    Scanner scanner;
+    scanner_init(&scanner, csv->row_starts[row], csv->row_starts[row + 1], &csv->dialect);
+    if (!split_record(&csv->allocator, &scanner, csv->row_starts[row], cells, csv->cols_count))
+    {
+        set_error(ERR_MEM_ALLOC);
+        return NULL;
+    }
+    csv->rows[row].cells = cells;
+    return cells;
+}
+
+// End Lazy Rows
+
+// Begin Typed Columns
+
+static void invalidate_typed_columns(CSV *csv)
+{
+    csv->typed = NULL;
+}
+
+// Converts the cells of rows [from, to) into typed, which must have room for them
+static void convert_cells(CSV *csv, u64 col, Typed_Column *typed, u64 from, u64 to)
+{
+    for (u64 row = from; row < to; row++)
+    {
+        String_View cell = *cell_at(csv, row, col);
+        typed->valid[row] = !is_cell_empty(cell);
+        switch (typed->type)
+        {
+            case CSV_TYPE_INTEGER:
+                typed->integers[row] = typed->valid[row] ? to_integer(cell) : 0;
+                break;
+            case CSV_TYPE_FLOAT:
+                typed->floats[row] = typed->valid[row] ? to_float(cell) : 0.0;
+                break;
+            default:
+                typed->booleans[row] = typed->valid[row] && (cell.data[0] == 't' || cell.data[0] == 'T');
+                break;
+        }
+    }
+}
+
+/*
+ * Converts every cell of an integer, float or boolean column once into a
+ * contiguous array, with valid[row] telling which rows hold a value. A
+ * column of strings, sampled types included, is left unconverted.
+ * @return s32: 0 on failure, the error is already set.
+ */
+static s32 materialize_column(CSV *csv, u64 col)
+{
+    if (!csv->typed)
+    {
+        csv->typed = arena_alloc(&csv->allocator, sizeof(Typed_Column) * csv->cols_count);
+        if (!csv->typed)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return 0;
+        }
+        memset(csv->typed, 0, sizeof(Typed_Column) * csv->cols_count);
+    }
+
+    Typed_Column *typed = &csv->typed[col];
+    if (typed->valid)
+    {
+        return 1;
+    }
+
+    if (csv->types_sampled)
+    {
+        // The type only saw a sample, promote it if a cell outside of it disagrees
+        u8 mask = TYPE_MASK_ALL;
+        u64 rows = csv->rows_count - 1 - csv->tail_rows;
+        for (u64 row = 0; row < rows; row++)
+        {
+            mask &= classify_cell(*cell_at(csv, row, col));
+        }
+        if (csv->type_masks)
+        {
+            csv->type_masks[col] = mask;
+        }
+        if (csv->tail_rows)
+        {
+            mask &= classify_cell(*cell_at(csv, rows, col));
+        }
+        csv->type[col] = type_from_mask(mask);
+    }
+
+    ColumnType type = csv->type[col];
+    if (type != CSV_TYPE_INTEGER && type != CSV_TYPE_FLOAT && type != CSV_TYPE_BOOLEAN)
+    {
+        // Left as text, typed_column_at reports it to the callers that need numbers
+        return 1;
+    }
+
+    u64 count = csv->rows_count - 1;
+    size_t value_size = type == CSV_TYPE_BOOLEAN ? sizeof(boolean) : sizeof(s64);
+    boolean *valid = arena_alloc(&csv->allocator, count * sizeof(boolean) + 1);
+    void *values = arena_alloc(&csv->allocator, count * value_size + 1);
+    if (!valid || !values)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+
+    typed->type = type;
+    typed->count = count;
+    typed->capacity = count;
+    typed->values = values;
+    typed->valid = valid;
+    convert_cells(csv, col, typed, 0, count);
+    return 1;
+}
+
+/*
+ * Converts the rows added to a filled typed column, growing its arrays
+ * geometrically.
+ * @return s32: 0 if the arena ran out of memory.
+ */
+static s32 extend_typed_column(CSV *csv, u64 col, u64 count)
+{
+    Typed_Column *typed = &csv->typed[col];
+    if (count > typed->capacity)
+    {
+        u64 capacity = typed->capacity ? typed->capacity : 1;
+        while (capacity < count)
+        {
+            capacity *= 2;
+        }
+        size_t value_size = typed->type == CSV_TYPE_BOOLEAN ? sizeof(boolean) : sizeof(s64);
+        boolean *valid = arena_realloc(&csv->allocator, typed->valid, typed->capacity * sizeof(boolean) + 1, capacity * sizeof(boolean) + 1);
+        void *values = arena_realloc(&csv->allocator, typed->values, typed->capacity * value_size + 1, capacity * value_size + 1);
+        if (!valid || !values)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return 0;
+        }
+        typed->valid = valid;
+        typed->values = values;
+        typed->capacity = capacity;
+    }
+    convert_cells(csv, col, typed, typed->count, count);
+    typed->count = count;
+    return 1;
+}
+
+static const Typed_Column *typed_column_at(CSV *csv, u64 col)
+{
+    if (!materialize_column(csv, col))
+    {
+        return NULL;
+    }
+    if (!csv->typed[col].valid)
+    {
+        set_error(ERR_CSV_DIFF_TYPE);
+        return NULL;
+    }
+    return &csv->typed[col];
+}
+
+const Typed_Column *get_typed_column(CSV *csv, String_View column_name)
+{
+    if (!csv)
+    {
+        set_error(ERR_CSV_EMPTY);
+        return NULL;
+    }
+
+    s32 col = get_column_index(&column_name);
+    if (col == -1)
+    {
+        set_error(ERR_COLUMN_NOT_FOUND);
+        return NULL;
+    }
+    return typed_column_at(csv, col);
+}
+
+static s32 materialize_typed_columns(CSV *csv)
+{
+    for (u64 col = 0; col < csv->cols_count; col++)
+    {
+        if (csv->type[col] != CSV_TYPE_STRING && csv->type[col] != CSV_TYPE_UNKNOWN && !materialize_column(csv, col))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Numeric value of a valid row of an integer or float column
+static inline double typed_value(const Typed_Column *typed, u64 row)
+{
+    return typed->type == CSV_TYPE_INTEGER ? (double)typed->integers[row] : typed->floats[row];
+}
+
+// End Typed Columns
+
+typedef enum {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+} Compression;
+
+static Compression detect_compression(const u8 *bytes, u64 size)
+{
+    if (size >= 2 && bytes[0] == 0x1F && bytes[1] == 0x8B)
+    {
+        return COMPRESSION_GZIP;
+    }
+    if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xB5 && bytes[2] == 0x2F && bytes[3] == 0xFD)
+    {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+// Defined with the streaming reader, which does the decompression
+static s32 load_compressed(const char *content, CSV *csv);
+
+// Shared tail of every loader once the rows are stored
+static s32 finish_load(CSV *csv)
+{
+    if (csv->layout == CSV_LAYOUT_COLUMNS)
+    {
+        for (u64 col = 0; col < csv->cols_count; col++)
+        {
+            csv->columns[col][0] = csv->header[col];
+        }
+    }
+
+    if (csv->materialize_types)
+    {
+        return materialize_typed_columns(csv);
+    }
+    return 1;
+}
+
+/*
+ * Records where csv_refresh resumes: after the last record of [buffer, end),
+ * or at its start when it has no newline, as the file may still be writing it.
+ * @param offset: Position of buffer in the file
+ */
+static void remember_tail(CSV *csv, u64 offset, u8 *buffer, u8 *end, const Parse_Tail *tail)
+{
+    csv->source_offset = offset + (end - buffer);
+    csv->tail_rows = 0;
+    if (tail->record && end > buffer && end[-1] != '\n')
+    {
+        csv->source_offset = offset + (tail->record - buffer);
+        csv->tail_rows = tail->kept;
+    }
+}
+
+/*
+ * Parses a whole buffer into csv, splitting the body across threads when
+ * threads is greater than one.
+ */
+static s32 load_from_buffer(CSV *csv, u8 *buffer, u8 *end, u32 threads)
+{
+    u8 *file = buffer;
+    while (buffer < end && (*buffer == '\n' || *buffer == '\r'))
+    {
+        buffer++;
+    }
+
+    if (csv->dialect.delimiter == 0)
+    {
+        csv->dialect = sniff_dialect(buffer, end - buffer);
+    }
+
+    Scanner scanner;
+    scanner_init(&scanner, buffer, end, &csv->dialect);
+    if (!parse_header(csv, &scanner, &buffer))
+    {
+        return 0;
+    }
+
+    if (csv->lazy && csv->filter.op == FILTER_NONE)
+    {
+        csv->layout = CSV_LAYOUT_ROWS;
+        if (!parse_lazy(csv, &scanner, buffer))
+        {
+            return 0;
+        }
+        return finish_load(csv);
+    }
+
+    Parse_Tail tail = {0};
+    if (threads > 1)
+    {
+        if (!parse_parallel(csv, buffer, end, threads, &tail))
+        {
+            return 0;
+        }
+    }
+    else if (!parse(csv, &scanner, buffer, &tail))
+    {
+        return 0;
+    }
+    if (buffer <= end)
+    {
+        // Otherwise the header had no newline and may still be growing
+        remember_tail(csv, buffer - file, buffer, end, &tail);
+    }
+    return finish_load(csv);
+}
+
+void read_csv(const char *content, CSV *csv)
+{
+    u8 *buffer = NULL;
+    FILE *file = fopen(content, "rb");
+    if (!file)
+    {
+        set_error(ERR_FILE_NOT_FOUND);
+        goto defer;
+    }
+
+    u8 magic[4];
+    size_t magic_size = fread(magic, 1, sizeof(magic), file);
+    if (detect_compression(magic, magic_size) != COMPRESSION_NONE)
+    {
+        fclose(file);
+        load_compressed(content, csv);
+        return;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size_t file_size = ftell(file);
+    rewind(file);
+
+    // The text gets a region of its own size, the cells grow in regions after it
+    buffer = arena_alloc(&csv->allocator, file_size + 1);
+    if (!buffer)
+    {
+        set_error(ERR_MEM_ALLOC);
+        goto defer;
+    }
+    csv->text_size += file_size + 1;
+    
+
+    fread(buffer, 1, file_size, file);
+    buffer[file_size] = '\0';
+
+    if (!load_from_buffer(csv, buffer, buffer + file_size, 1))
+    {
+        goto defer;
+    }
+    
+    fclose(file);
+    return;
+
+defer:
+    if (file)
+    {
+        fclose(file);
+    }
+
+    if (buffer)
+    {
+        arena_free(&csv->allocator);
+    }
+    return;
+}
+
+static u8 *map_file(const char *content, CSV *csv, boolean writable)
+{
+    s32 fd = open(content, O_RDONLY);
+    if (fd == -1)
+    {
+        set_error(ERR_FILE_NOT_FOUND);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        set_error(ERR_OPEN_FILE);
+        close(fd);
+        return NULL;
+    }
+
+    if (st.st_size == 0)
+    {
+        set_error(ERR_CSV_EMPTY);
+        close(fd);
+        return NULL;
+    }
+
+    // A writable private mapping is copied on write, the file is never modified
+    s32 prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    u8 *mapping = mmap(NULL, st.st_size, prot, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps its own reference to the file
+    if (mapping == MAP_FAILED)
+    {
+        set_error(ERR_MAP_FILE);
+        return NULL;
+    }
+
+    csv->mapping = mapping;
+    csv->mapping_size = st.st_size;
+    return mapping;
+}
+
+void read_csv_mmap(const char *content, CSV *csv, boolean sequential)
+{
+    u8 *mapping = map_file(content, csv, FALSE);
+    if (!mapping)
+    {
+        return;
+    }
+    if (detect_compression(mapping, csv->mapping_size) != COMPRESSION_NONE)
+    {
+        deinit_csv(csv);
+        load_compressed(content, csv);
+        return;
+    }
+
+    if (sequential)
+    {
+        madvise(mapping, csv->mapping_size, MADV_SEQUENTIAL);
+    }
+
+    if (!load_from_buffer(csv, mapping, mapping + csv->mapping_size, 1))
+    {
+        deinit_csv(csv);
+        return;
+    }
+
+    if (sequential)
+    {
+        // Cells are accessed in any order after the parse pass
+        madvise(mapping, csv->mapping_size, MADV_NORMAL);
+    }
+}
+
+void read_csv_parallel(const char *content, CSV *csv, u32 threads)
+{
+    if (threads == 0)
+    {
+        s64 online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? online : 1;
+    }
+
+    u8 *mapping = map_file(content, csv, FALSE);
+    if (!mapping)
+    {
+        return;
+    }
+    if (detect_compression(mapping, csv->mapping_size) != COMPRESSION_NONE)
+    {
+        deinit_csv(csv);
+        load_compressed(content, csv);
+        return;
+    }
+
+    if (!load_from_buffer(csv, mapping, mapping + csv->mapping_size, threads))
+    {
+        deinit_csv(csv);
+        return;
+    }
+}
+
+/*
+ * Keeps only the requested columns of a parsed header, in the requested
+ * order. The other names are shadowed in the index table so they are not
+ * found anymore.
+ * @return: The kept column of every field of the file, -1 for dropped ones,
+ * NULL on failure.
+ */
+static s32 *project_header(CSV *csv, const String_View *names, u32 count, u64 *last_col)
+{
+    u64 source_cols = csv->cols_count;
+    s32 *projection = arena_alloc(&csv->allocator, sizeof(s32) * source_cols);
+    String_View *header = arena_alloc(&csv->allocator, sizeof(String_View) * count);
+    if (!projection || !header)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return NULL;
+    }
+    for (u64 col = 0; col < source_cols; col++)
+    {
+        projection[col] = -1;
+    }
+
+    *last_col = 0;
+    for (u32 i = 0; i < count; i++)
+    {
+        String_View name = names[i];
+        s32 col = get_column_index(&name);
+        if (col == -1)
+        {
+            set_error(ERR_COLUMN_NOT_FOUND);
+            return NULL;
+        }
+        if (projection[col] != -1)
+        {
+            set_error(ERR_INVALID_ARG);
+            return NULL;
+        }
+        projection[col] = i;
+        header[i] = csv->header[col];
+        *last_col = (u64)col > *last_col ? (u64)col : *last_col;
+    }
+
+    for (u64 col = 0; col < source_cols; col++)
+    {
+        insert_into_hash(csv, &csv->header[col], projection[col]);
+    }
+    csv->header = header;
+    csv->cols_count = count;
+    return projection;
+}
+
+void read_csv_columns(const char *content, String_View *names, u32 count, CSV *csv)
+{
+    if (!names || count == 0)
+    {
+        set_error(ERR_INVALID_ARG);
+        return;
+    }
+
+    u8 *buffer = map_file(content, csv, FALSE);
+    if (!buffer)
+    {
+        return;
+    }
+    if (detect_compression(buffer, csv->mapping_size) != COMPRESSION_NONE)
+    {
+        // Fields cannot be skipped in a compressed file
+        set_error(ERR_COMPRESSION);
+        deinit_csv(csv);
+        return;
+    }
+    u8 *end = buffer + csv->mapping_size;
+    madvise(buffer, csv->mapping_size, MADV_SEQUENTIAL);
+
+    while (buffer < end && (*buffer == '\n' || *buffer == '\r'))
+    {
+        buffer++;
+    }
+    if (csv->dialect.delimiter == 0)
+    {
+        csv->dialect = sniff_dialect(buffer, end - buffer);
+    }
+
+    Scanner scanner;
+    scanner_init(&scanner, buffer, end, &csv->dialect);
+    if (!parse_header(csv, &scanner, &buffer))
+    {
+        deinit_csv(csv);
+        return;
+    }
+
+    // The filter's column is resolved before the other names are shadowed
+    Parsed_Rows parsed;
+    if (!parsed_rows_config(csv, &parsed))
+    {
+        deinit_csv(csv);
+        return;
+    }
+    parsed.projection = project_header(csv, names, count, &parsed.last_col);
+    parsed.cols_count = csv->cols_count;
+    if (!parsed.projection)
+    {
+        deinit_csv(csv);
+        return;
+    }
+    if (parsed.filter && parsed.filter_col > parsed.last_col)
+    {
+        parsed.last_col = parsed.filter_col;
+    }
+    if (!parsed_rows_init(&csv->allocator, &parsed) || !parse_rows(&csv->allocator, &scanner, buffer, &parsed))
+    {
+        set_error(ERR_MEM_ALLOC);
+        deinit_csv(csv);
+        return;
+    }
+    if (!store_parsed(csv, &parsed) || !finish_load(csv))
+    {
+        deinit_csv(csv);
+        return;
+    }
+    madvise(csv->mapping, csv->mapping_size, MADV_NORMAL);
+}
+
+// Begin Pipeline
+
+/*
+ * Reads a file into one buffer on its own thread while the caller parses what
+ * is already there. The reader stays at most window bytes ahead of the last
+ * byte the parser has seen.
+ */
+typedef struct Read_Pipeline {
+    s32 fd;
+    u8 *buffer;
+    u64 size;
+    u64 window;
+    u64 filled;   // bytes read so far
+    u64 seen;     // bytes the parser has looked at
+    boolean done;
+    boolean failed;
+    boolean cancel;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Read_Pipeline;
+
+static void *pipeline_read_worker(void *arg)
+{
+    Read_Pipeline *p = arg;
+    u64 filled = 0;
+    boolean done = FALSE;
+    boolean failed = FALSE;
+    while (!done)
+    {
+        pthread_mutex_lock(&p->lock);
+        while (filled - p->seen >= p->window && !p->cancel)
+        {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        boolean cancel = p->cancel;
+        pthread_mutex_unlock(&p->lock);
+        if (cancel)
+        {
+            break;
+        }
+
+        u64 wanted = p->size - filled < READER_CHUNK_SIZE ? p->size - filled : READER_CHUNK_SIZE;
+        ssize_t got = read(p->fd, p->buffer + filled, wanted);
+        if (got > 0)
+        {
+            filled += got;
+        }
+        failed = got < 0;
+        done = got <= 0 || filled == p->size;
+
+        pthread_mutex_lock(&p->lock);
+        p->filled = filled;
+        p->done = done;
+        p->failed = failed;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Tells the reader that the first seen bytes were looked at and waits until
+ * more are read.
+ * @return: Bytes read so far, *done is set once the reader is finished.
+ */
+static u64 pipeline_wait(Read_Pipeline *p, u64 seen, boolean *done)
+{
+    pthread_mutex_lock(&p->lock);
+    p->seen = seen;
+    pthread_cond_broadcast(&p->cond);
+    while (p->filled <= seen && !p->done)
+    {
+        pthread_cond_wait(&p->cond, &p->lock);
+    }
+    u64 filled = p->filled;
+    *done = p->done;
+    pthread_mutex_unlock(&p->lock);
+    return filled;
+}
+
+/*
+ * Scans [*scan, end) for the newline that ends the record being read, so a
+ * record cut across many rounds only has its new bytes scanned each round.
+ * @param scan: Where the last round stopped, moved to end if no record ends
+ * @param in_quote: Quote state at *scan, kept up to date with it
+ * @return boolean: True once the record has ended.
+ */
+static boolean pipeline_record_ends(u8 **scan, u8 *end, const CSV_Dialect *dialect, boolean *in_quote)
+{
+    Scanner scanner;
+    u8 *pos;
+    boolean is_newline = FALSE;
+    scanner_init_at(&scanner, *scan, end, dialect, *in_quote);
+    while (!is_newline && scanner_next(&scanner, &pos, &is_newline))
+    {
+    }
+    if (is_newline)
+    {
+        return TRUE;
+    }
+    *scan = end;
+    *in_quote = scanner.in_quote != 0;
+    return FALSE;
+}
+
+/*
+ * Waits until the header record is read, sniffs the dialect if needed and
+ * parses the header.
+ * @return: The first byte after the header, NULL on failure.
+ */
+static u8 *pipeline_parse_header(Read_Pipeline *p, CSV *csv)
+{
+    u64 filled = 0;
+    boolean done = FALSE;
+    u8 *scan = p->buffer;
+    boolean in_quote = FALSE;
+    while (TRUE)
+    {
+        filled = pipeline_wait(p, filled, &done);
+        u8 *begin = p->buffer;
+        u8 *end = p->buffer + filled;
+        while (begin < end && (*begin == '\n' || *begin == '\r'))
+        {
+            begin++;
+        }
+        if (scan < begin)
+        {
+            scan = begin;
+        }
+
+        if (csv->dialect.delimiter == 0 && (done || (u64)(end - begin) >= SNIFF_SIZE))
+        {
+            csv->dialect = sniff_dialect(begin, end - begin);
+        }
+        if (csv->dialect.delimiter == 0)
+        {
+            continue;
+        }
+
+        if (done || pipeline_record_ends(&scan, end, &csv->dialect, &in_quote))
+        {
+            Scanner scanner;
+            scanner_init(&scanner, begin, end, &csv->dialect);
+            return parse_header(csv, &scanner, &begin) ? begin : NULL;
+        }
+    }
+}
+
+/*
+ * Parses the rows as the reader thread reads them. The record cut by the end
+ * of the bytes read so far is parsed again once its newline is read.
+ * @return s32: 0 on failure, the error is already set.
+ */
+static s32 pipeline_parse(Read_Pipeline *p, CSV *csv)
+{
+    u8 *current = pipeline_parse_header(p, csv);
+    if (!current)
+    {
+        return 0;
+    }
+    u8 *rows = current;
+
+    Parsed_Rows parsed;
+    if (!parsed_rows_config(csv, &parsed))
+    {
+        return 0;
+    }
+    parsed.tail_apart = TRUE;
+    if (!parsed_rows_init(&csv->allocator, &parsed))
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+
+    boolean done = FALSE;
+    u64 filled = 0;
+    u8 *scan = current;
+    boolean in_quote = FALSE;
+    while (TRUE)
+    {
+        filled = pipeline_wait(p, filled, &done);
+        u8 *end = p->buffer + filled;
+        if (current >= end && done)
+        {
+            break;
+        }
+        if (!done && !pipeline_record_ends(&scan, end, &csv->dialect, &in_quote))
+        {
+            continue;
+        }
+
+        parsed.partial_tail = !done;
+        Scanner scanner;
+        scanner_init(&scanner, current, end, &csv->dialect);
+        current = parse_rows(&csv->allocator, &scanner, current, &parsed);
+        if (!current)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return 0;
+        }
+        if (done)
+        {
+            break;
+        }
+        scan = current;
+        in_quote = FALSE;
+    }
+
+    u8 *end = p->buffer + filled;
+    if (rows <= end)
+    {
+        Parse_Tail tail = {parsed.last_record, parsed.last_kept};
+        remember_tail(csv, rows - p->buffer, rows, end, &tail);
+    }
+    return store_parsed(csv, &parsed);
+}
+
+void read_csv_pipelined(const char *content, CSV *csv, u32 buffers)
+{
+    Read_Pipeline p = { .fd = open(content, O_RDONLY) };
+    if (p.fd == -1)
+    {
+        set_error(ERR_FILE_NOT_FOUND);
+        return;
+    }
+
+    struct stat st;
+    if (fstat(p.fd, &st) == -1)
+    {
+        set_error(ERR_OPEN_FILE);
+        close(p.fd);
+        return;
+    }
+    if (st.st_size == 0)
+    {
+        set_error(ERR_CSV_EMPTY);
+        close(p.fd);
+        return;
+    }
+
+    u8 magic[4];
+    ssize_t magic_size = pread(p.fd, magic, sizeof(magic), 0);
+    if (magic_size > 0 && detect_compression(magic, magic_size) != COMPRESSION_NONE)
+    {
+        // Decompression already runs on its own thread
+        close(p.fd);
+        load_compressed(content, csv);
+        return;
+    }
+
+    p.size = st.st_size;
+    p.window = (u64)(buffers ? buffers : PIPELINE_BUFFERS) * READER_CHUNK_SIZE;
+    p.buffer = arena_alloc(&csv->allocator, p.size + 1);
+    if (!p.buffer)
+    {
+        set_error(ERR_MEM_ALLOC);
+        close(p.fd);
+        return;
+    }
+    csv->text_size += p.size + 1;
+    p.buffer[p.size] = '\0';
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.cond, NULL);
+
+    s32 ok;
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, pipeline_read_worker, &p) != 0)
+    {
+        // No thread to overlap with, read everything up front
+        p.window = p.size;
+        pipeline_read_worker(&p);
+        ok = pipeline_parse(&p, csv);
+    }
+    else
+    {
+        ok = pipeline_parse(&p, csv);
+        pthread_mutex_lock(&p.lock);
+        p.cancel = TRUE;
+        pthread_cond_broadcast(&p.cond);
+        pthread_mutex_unlock(&p.lock);
+        pthread_join(reader, NULL);
+    }
+    pthread_cond_destroy(&p.cond);
+    pthread_mutex_destroy(&p.lock);
+    close(p.fd);
+
+    if (ok && p.failed)
+    {
+        set_error(ERR_READ_FILE);
+        ok = 0;
+    }
+    if (!ok || !finish_load(csv))
+    {
+        arena_free(&csv->allocator);
+    }
+}
+
+// End Pipeline
+
+// Begin Refresh
+
+/*
+ * Reads [offset, size) of fd into the arena, NUL terminated.
+ * @return: The bytes read, NULL on failure with the error set.
+ */
+static u8 *read_appended(CSV *csv, s32 fd, u64 offset, u64 size)
+{
+    u8 *buffer = arena_alloc(&csv->allocator, size - offset + 1);
+    if (!buffer)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return NULL;
+    }
+    csv->text_size += size - offset + 1;
+
+    u64 length = 0;
+    while (offset + length < size)
+    {
+        ssize_t got = pread(fd, buffer + length, size - offset - length, offset + length);
+        if (got <= 0)
+        {
+            set_error(ERR_READ_FILE);
+            return NULL;
+        }
+        length += got;
+    }
+    buffer[length] = '\0';
+    return buffer;
+}
+
+/*
+ * Promotes the column types the new rows disagree with and brings the typed
+ * columns up to date: extended when their type held, dropped otherwise.
+ * @param kept_rows: Rows that were already converted and are still there
+ */
+static s32 refresh_types(CSV *csv, const Parsed_Rows *parsed, u64 kept_rows)
+{
+    for (u64 col = 0; col < csv->cols_count; col++)
+    {
+        csv->type_masks[col] &= parsed->type_masks[col];
+        ColumnType type = type_from_mask(csv->type_masks[col] & parsed->tail_masks[col]);
+        if (type == csv->type[col])
+        {
+            continue;
+        }
+        csv->type[col] = type;
+        if (csv->typed)
+        {
+            csv->typed[col] = (Typed_Column){0};
+        }
+    }
+
+    for (u64 col = 0; csv->typed && col < csv->cols_count; col++)
+    {
+        Typed_Column *typed = &csv->typed[col];
+        if (!typed->valid)
+        {
+            continue;
+        }
+        if (typed->count > kept_rows)
+        {
+            typed->count = kept_rows;
+        }
+        if (!extend_typed_column(csv, col, csv->rows_count - 1))
+        {
+            return 0;
+        }
+    }
+
+    if (csv->materialize_types)
+    {
+        return materialize_typed_columns(csv);
+    }
+    return 1;
+}
+
+void csv_refresh(CSV *csv, const char *content)
+{
+    if (!csv || !content || csv->source_offset == 0 || csv->lazy || !csv->type_masks)
+    {
+        set_error(ERR_INVALID_ARG);
+        return;
+    }
+
+    s32 fd = open(content, O_RDONLY);
+    if (fd == -1)
+    {
+        set_error(ERR_FILE_NOT_FOUND);
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        set_error(ERR_READ_FILE);
+        close(fd);
+        return;
+    }
+    u64 size = st.st_size;
+    if (size < csv->source_offset)
+    {
+        set_error(ERR_SOURCE_CHANGED);
+        close(fd);
+        return;
+    }
+    if (size == csv->source_offset)
+    {
+        close(fd);
+        return;
+    }
+
+    u8 *buffer = read_appended(csv, fd, csv->source_offset, size);
+    close(fd);
+    if (!buffer)
+    {
+        return;
+    }
+    u8 *end = buffer + (size - csv->source_offset);
+
+    Parsed_Rows parsed;
+    if (!parsed_rows_config(csv, &parsed))
+    {
+        return;
+    }
+    // Every new row is classified, so the masks stay exact from here on
+    parsed.sampling = (Type_Sampling){0};
+    parsed.rows = csv->rows;
+    parsed.columns = csv->columns;
+    parsed.capacity = csv->rows_capacity;
+    // The last row was cut off, drop it so it is parsed again whole
+    parsed.count = csv->rows_count - 1 - csv->tail_rows;
+    parsed.type_masks = (u8 *)arena_alloc(&csv->allocator, csv->cols_count);
+    if (!parsed.type_masks)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return;
+    }
+    memset(parsed.type_masks, TYPE_MASK_ALL, csv->cols_count);
+    parsed.tail_apart = TRUE;
+    parsed.tail_masks = (u8 *)arena_alloc(&csv->allocator, csv->cols_count);
+    if (!parsed.tail_masks)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return;
+    }
+    memset(parsed.tail_masks, TYPE_MASK_ALL, csv->cols_count);
+    // Types to put back if the new rows cannot be converted
+    ColumnType *old_types = (ColumnType *)arena_alloc(&csv->allocator, sizeof(ColumnType) * csv->cols_count);
+    u8 *old_masks = (u8 *)arena_alloc(&csv->allocator, csv->cols_count);
+    if (!old_types || !old_masks)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return;
+    }
+    memcpy(old_types, csv->type, sizeof(ColumnType) * csv->cols_count);
+    memcpy(old_masks, csv->type_masks, csv->cols_count);
+    if (parsed.layout == CSV_LAYOUT_COLUMNS || parsed.filter)
+    {
+        parsed.scratch = (String_View *)arena_alloc(&csv->allocator, sizeof(String_View) * csv->cols_count);
+        if (!parsed.scratch)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return;
+        }
+    }
+
+    Scanner scanner;
+    scanner_init(&scanner, buffer, end, &csv->dialect);
+    if (!parse_rows(&csv->allocator, &scanner, buffer, &parsed))
+    {
+        set_error(ERR_MEM_ALLOC);
+        return;
+    }
+
+    u64 kept_rows = csv->rows_count - 1 - csv->tail_rows;
+    u64 old_rows_count = csv->rows_count;
+    u64 old_offset = csv->source_offset;
+    u64 old_tail_rows = csv->tail_rows;
+    Parse_Tail tail = {parsed.last_record, parsed.last_kept};
+    remember_tail(csv, csv->source_offset, buffer, end, &tail);
+    // Kept even if the types fail below, the tables may have moved
+    csv->rows = parsed.rows;
+    csv->columns = parsed.columns;
+    csv->rows_count = parsed.count + 1; // for header
+    csv->rows_capacity = parsed.capacity;
+    if (!refresh_types(csv, &parsed, kept_rows))
+    {
+        // Back to the rows before, the next refresh parses the new ones again.
+        // Typed columns may be half converted, they are filled again on use
+        csv->rows_count = old_rows_count;
+        csv->source_offset = old_offset;
+        csv->tail_rows = old_tail_rows;
+        memcpy(csv->type, old_types, sizeof(ColumnType) * csv->cols_count);
+        memcpy(csv->type_masks, old_masks, csv->cols_count);
+        if (csv->typed)
+        {
+            memset(csv->typed, 0, sizeof(Typed_Column) * csv->cols_count);
+        }
+    }
+}
+
+// End Refresh
+
+// Begin Cache
+
+/*
+ * Identifies the source file a cache was built from. The hash covers the
+ * first and last CACHE_HASH_SAMPLE bytes, which catches most rewrites that
+ * keep the size and the modification time.
+ */
+typedef struct Cache_Key {
+    u64 size;
+    s64 mtime_sec;
+    s64 mtime_nsec;
+    u64 hash;
+} Cache_Key;
+
+/*
+ * Start of a cache file. Every section is 8-byte aligned and every pointer
+ * in it is stored as an offset from the start of the file, 0 being NULL.
+ */
+typedef struct Cache_Header {
+    u64 magic;
+    u64 version;
+    Cache_Key key;
+    u64 file_size;
+    u64 cols_count;
+    u64 rows_count;
+    u64 layout;
+    u64 types_sampled;
+    CSV_Dialect dialect;
+    u64 types_offset;  // ColumnType[cols_count]
+    u64 header_offset; // String_View[cols_count]
+    u64 table_offset;  // Row[rows_count - 1] or String_View *[cols_count]
+    u64 cells_offset;  // the String_View arrays the table points to
+    u64 typed_offset;  // Typed_Column[cols_count] and their arrays, 0 if none
+    u64 text_offset;   // bytes of every cell, in the order they are stored
+} Cache_Header;
+
+static u64 fnv1a(u64 hash, const u8 *bytes, u64 size)
+{
+    for (u64 i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static s32 cache_key(const char *source, Cache_Key *key)
+{
+    s32 fd = open(source, O_RDONLY);
+    if (fd == -1)
+    {
+        set_error(ERR_FILE_NOT_FOUND);
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        set_error(ERR_OPEN_FILE);
+        close(fd);
+        return 0;
+    }
+    memset(key, 0, sizeof(*key));
+    key->size = st.st_size;
+    key->mtime_sec = st.st_mtim.tv_sec;
+    key->mtime_nsec = st.st_mtim.tv_nsec;
+    key->hash = 0xCBF29CE484222325ULL;
+
+    u8 sample[CACHE_HASH_SAMPLE];
+    u64 head = key->size < CACHE_HASH_SAMPLE ? key->size : CACHE_HASH_SAMPLE;
+    u64 tail_start = key->size - head;
+    s32 ok = pread(fd, sample, head, 0) == (ssize_t)head;
+    key->hash = fnv1a(key->hash, sample, head);
+    ok = ok && pread(fd, sample, head, tail_start) == (ssize_t)head;
+    key->hash = fnv1a(key->hash, sample, head);
+    close(fd);
+    if (!ok)
+    {
+        set_error(ERR_READ_FILE);
+    }
+    return ok;
+}
+
+/*
+ * Writes views as stored in a cache, their data replaced by where their bytes
+ * will be in the text section. *text is advanced past them.
+ */
+static s32 cache_write_views(FILE *file, const String_View *views, u64 count, u64 *text)
+{
+    String_View batch[256];
+    u64 batched = 0;
+    for (u64 i = 0; i < count; i++)
+    {
+        String_View *view = &batch[batched++];
+        view->data = NULL;
+        view->size = views[i].size;
+        if (views[i].data)
+        {
+            view->data = (u8 *)(uintptr_t)*text;
+            *text += views[i].size;
+        }
+        if (batched == sizeof(batch) / sizeof(batch[0]) || i + 1 == count)
+        {
+            if (fwrite(batch, sizeof(String_View), batched, file) != batched)
+            {
+                return 0;
+            }
+            batched = 0;
+        }
+    }
+    return 1;
+}
+
+static s32 cache_write_text(FILE *file, const String_View *views, u64 count)
+{
+    for (u64 i = 0; i < count; i++)
+    {
+        if (views[i].data && fwrite(views[i].data, 1, views[i].size, file) != views[i].size)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static s32 cache_pad(FILE *file, u64 *offset)
+{
+    static const u8 zeros[8] = {0};
+    u64 aligned = ALIGN_UP(*offset, 8);
+    if (fwrite(zeros, 1, aligned - *offset, file) != aligned - *offset)
+    {
+        return 0;
+    }
+    *offset = aligned;
+    return 1;
+}
+
+void csv_save_cache(const char *cache_path, const char *source_path, CSV *csv)
+{
+    if (!csv || !csv->header)
+    {
+        set_error(ERR_CSV_EMPTY);
+        return;
+    }
+
+    Cache_Header header = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .cols_count = csv->cols_count,
+        .rows_count = csv->rows_count,
+        .layout = csv->layout,
+        .types_sampled = csv->types_sampled,
+        .dialect = csv->dialect,
+    };
+    if (!cache_key(source_path, &header.key))
+    {
+        return;
+    }
+
+    u64 cols = csv->cols_count;
+    u64 rows = csv->rows_count - 1;
+    boolean columns = csv->layout == CSV_LAYOUT_COLUMNS;
+    for (u64 row = 0; !columns && row < rows; row++)
+    {
+        // The cache holds every cell, lazy rows are split now
+        if (!row_cells(csv, row))
+        {
+            return;
+        }
+    }
+    u64 cells_count = columns ? cols * (rows + 1) : cols * rows;
+    u64 table_size = columns ? sizeof(String_View *) * cols : sizeof(Row) * rows;
+
+    header.types_offset = ALIGN_UP(sizeof(Cache_Header), 8);
+    header.header_offset = ALIGN_UP(header.types_offset + sizeof(ColumnType) * cols, 8);
+    header.table_offset = header.header_offset + sizeof(String_View) * cols;
+    header.cells_offset = header.table_offset + table_size;
+    u64 offset = header.cells_offset + sizeof(String_View) * cells_count;
+    if (csv->typed)
+    {
+        header.typed_offset = offset;
+        offset += sizeof(Typed_Column) * cols;
+        for (u64 col = 0; col < cols; col++)
+        {
+            const Typed_Column *typed = &csv->typed[col];
+            if (typed->valid)
+            {
+                size_t value_size = typed->type == CSV_TYPE_BOOLEAN ? sizeof(boolean) : sizeof(s64);
+                offset = ALIGN_UP(offset + typed->count * value_size, 8) + ALIGN_UP(typed->count * sizeof(boolean), 8);
+            }
+        }
+    }
+    header.text_offset = offset;
+
+    FILE *file = fopen(cache_path, "wb");
+    if (!file)
+    {
+        set_error(ERR_OPEN_FILE);
+        return;
+    }
+    setvbuf(file, NULL, _IOFBF, READER_CHUNK_SIZE);
+
+    // The size is only known once every section is written
+    s32 ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    u64 written = sizeof(header);
+    ok = ok && cache_pad(file, &written);
+    ok = ok && fwrite(csv->type, sizeof(ColumnType), cols, file) == cols;
+    written += sizeof(ColumnType) * cols;
+    ok = ok && cache_pad(file, &written);
+
+    u64 text = header.text_offset;
+    ok = ok && cache_write_views(file, csv->header, cols, &text);
+    for (u64 i = 0; ok && i < (columns ? cols : rows); i++)
+    {
+        // Every row or column is stored right after the previous one
+        u64 count = columns ? rows + 1 : cols;
+        u64 cells = header.cells_offset + sizeof(String_View) * count * i;
+        ok = fwrite(&cells, sizeof(cells), 1, file) == 1;
+    }
+    for (u64 i = 0; ok && i < (columns ? cols : rows); i++)
+    {
+        ok = columns ? cache_write_views(file, csv->columns[i], rows + 1, &text)
+                     : cache_write_views(file, csv->rows[i].cells, cols, &text);
+    }
+
+    written = header.cells_offset + sizeof(String_View) * cells_count;
+    if (ok && csv->typed)
+    {
+        offset = header.typed_offset + sizeof(Typed_Column) * cols;
+        for (u64 col = 0; ok && col < cols; col++)
+        {
+            Typed_Column typed = csv->typed[col];
+            if (typed.valid)
+            {
+                size_t value_size = typed.type == CSV_TYPE_BOOLEAN ? sizeof(boolean) : sizeof(s64);
+                typed.values = (void *)(uintptr_t)offset;
+                offset = ALIGN_UP(offset + typed.count * value_size, 8);
+                typed.valid = (boolean *)(uintptr_t)offset;
+                offset += ALIGN_UP(typed.count * sizeof(boolean), 8);
+                typed.capacity = typed.count;
+            }
+            ok = fwrite(&typed, sizeof(typed), 1, file) == 1;
+        }
+        written += sizeof(Typed_Column) * cols;
+        for (u64 col = 0; ok && col < cols; col++)
+        {
+            const Typed_Column *typed = &csv->typed[col];
+            if (typed->valid)
+            {
+                size_t value_size = typed->type == CSV_TYPE_BOOLEAN ? sizeof(boolean) : sizeof(s64);
+                ok = fwrite(typed->values, value_size, typed->count, file) == typed->count;
+                written += value_size * typed->count;
+                ok = ok && cache_pad(file, &written);
+                ok = ok && fwrite(typed->valid, sizeof(boolean), typed->count, file) == typed->count;
+                written += sizeof(boolean) * typed->count;
+                ok = ok && cache_pad(file, &written);
+            }
+        }
+    }
+
+    ok = ok && cache_write_text(file, csv->header, cols);
+    for (u64 i = 0; ok && i < (columns ? cols : rows); i++)
+    {
+        ok = columns ? cache_write_text(file, csv->columns[i], rows + 1)
+                     : cache_write_text(file, csv->rows[i].cells, cols);
+    }
+
+    header.file_size = text;
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    if (fclose(file) != 0 || !ok)
+    {
+        set_error(ERR_WRITE_FILE);
+        remove(cache_path);
+    }
+}
+
+// Whether count items of size bytes from offset lie within a cache of file_size bytes
+static inline boolean cache_fits(u64 file_size, u64 offset, u64 count, u64 size)
+{
+    return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+/*
+ * Turns the count views stored at offset back into pointers, checking that
+ * they and their bytes lie within the cache.
+ * @return: The views, NULL if the cache is corrupt.
+ */
+static String_View *cache_views_at(u8 *base, u64 file_size, u64 offset, u64 count)
+{
+    if (offset % 8 != 0 || !cache_fits(file_size, offset, count, sizeof(String_View)))
+    {
+        return NULL;
+    }
+
+    String_View *views = (String_View *)(base + offset);
+    for (u64 i = 0; i < count; i++)
+    {
+        if (views[i].data)
+        {
+            u64 text = (uintptr_t)views[i].data;
+            if (!cache_fits(file_size, text, views[i].size, 1))
+            {
+                return NULL;
+            }
+            views[i].data = base + text;
+        }
+    }
+    return views;
+}
+
+/*
+ * Turns the typed columns stored at offset back into pointers, checking that
+ * their arrays lie within the cache.
+ * @return s32: 1 on success, 0 if the cache is corrupt.
+ */
+static s32 cache_typed_at(u8 *base, u64 file_size, u64 offset, u64 cols, u64 rows, Typed_Column **out)
+{
+    if (offset % 8 != 0 || !cache_fits(file_size, offset, cols, sizeof(Typed_Column)))
+    {
+        return 0;
+    }
+
+    Typed_Column *typed = (Typed_Column *)(base + offset);
+    for (u64 col = 0; col < cols; col++)
+    {
+        if (!typed[col].valid)
+        {
+            continue;
+        }
+        ColumnType type = typed[col].type;
+        if (type != CSV_TYPE_INTEGER && type != CSV_TYPE_FLOAT && type != CSV_TYPE_BOOLEAN)
+        {
+            return 0;
+        }
+        size_t value_size = type == CSV_TYPE_BOOLEAN ? sizeof(boolean) : sizeof(s64);
+        u64 values = (uintptr_t)typed[col].values;
+        u64 valid = (uintptr_t)typed[col].valid;
+        if (typed[col].count != rows || values % value_size != 0 ||
+            !cache_fits(file_size, values, rows, value_size) || !cache_fits(file_size, valid, rows, sizeof(boolean)))
+        {
+            return 0;
+        }
+        typed[col].capacity = rows;
+        typed[col].values = base + values;
+        typed[col].valid = (boolean *)(base + valid);
+    }
+    *out = typed;
+    return 1;
+}
+
+void csv_load_cache(const char *cache_path, const char *source_path, CSV *csv)
+{
+    Cache_Key key;
+    if (!cache_key(source_path, &key))
+    {
+        return;
+    }
+
+    u8 *base = map_file(cache_path, csv, TRUE);
+    if (!base)
+    {
+        return;
+    }
+
+    u64 size = csv->mapping_size;
+    Cache_Header *header = (Cache_Header *)base;
+    if (size < sizeof(Cache_Header) || header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+        header->file_size != size || memcmp(&header->key, &key, sizeof(key)) != 0 ||
+        header->cols_count == 0 || header->rows_count == 0)
+    {
+        set_error(ERR_CACHE_STALE);
+        deinit_csv(csv);
+        return;
+    }
+
+    // The header matches, the body is checked as its offsets are turned
+    // back into pointers. The mapping is private, so a failure halfway
+    // leaves the file as it was
+    u64 cols = header->cols_count;
+    u64 rows = header->rows_count - 1;
+    boolean columns = header->layout == CSV_LAYOUT_COLUMNS;
+    u64 tables = columns ? cols : rows;
+    u64 count = columns ? rows + 1 : cols;
+    ColumnType *types = (ColumnType *)(base + header->types_offset);
+    // The sections must follow each other as csv_save_cache lays them out,
+    // so none of the views and tables fixed up in place can overlap
+    if ((header->layout != CSV_LAYOUT_ROWS && !columns) || header->types_offset % 8 != 0 ||
+        !cache_fits(size, header->types_offset, cols, sizeof(ColumnType)) ||
+        header->header_offset != ALIGN_UP(header->types_offset + sizeof(ColumnType) * cols, 8) ||
+        !cache_fits(size, header->header_offset, cols, sizeof(String_View)) ||
+        header->table_offset != header->header_offset + sizeof(String_View) * cols ||
+        !cache_fits(size, header->table_offset, tables, sizeof(String_View *)) ||
+        header->cells_offset != header->table_offset + sizeof(String_View *) * tables)
+    {
+        goto stale;
+    }
+    for (u64 col = 0; col < cols; col++)
+    {
+        if ((u32)types[col] > CSV_TYPE_UNKNOWN)
+        {
+            goto stale;
+        }
+    }
+
+    String_View *names = cache_views_at(base, size, header->header_offset, cols);
+    if (!names)
+    {
+        goto stale;
+    }
+
+    u8 *table = base + header->table_offset;
+    u64 cells_end = header->cells_offset;
+    for (u64 i = 0; i < tables; i++)
+    {
+        // Every row or column is stored right after the previous one
+        String_View **views = columns ? &((String_View **)table)[i] : &((Row *)table)[i].cells;
+        if ((uintptr_t)*views != cells_end)
+        {
+            goto stale;
+        }
+        *views = cache_views_at(base, size, cells_end, count);
+        if (!*views)
+        {
+            goto stale;
+        }
+        cells_end += sizeof(String_View) * count;
+    }
+
+    Typed_Column *typed = NULL;
+    if (header->typed_offset &&
+        (header->typed_offset != cells_end || !cache_typed_at(base, size, header->typed_offset, cols, rows, &typed)))
+    {
+        goto stale;
+    }
+
+    csv->cols_count = cols;
+    csv->rows_count = header->rows_count;
+    csv->layout = header->layout;
+    csv->types_sampled = header->types_sampled;
+    csv->dialect = header->dialect;
+    csv->type = types;
+    csv->header = names;
+    csv->columns = columns ? (String_View **)table : NULL;
+    csv->rows = columns ? NULL : (Row *)table;
+    csv->typed = typed;
+    for (u64 col = 0; col < cols; col++)
+    {
+        insert_into_hash(csv, &csv->header[col], col);
+    }
+    return;
+
+stale:
+    set_error(ERR_CACHE_STALE);
+    deinit_csv(csv);
+}
+
+// End Cache
+
+// Begin Row Index
+
+/*
+ * Start of a row index file, followed by the byte offsets of data rows 0,
+ * stride, 2 * stride... The index lives next to the csv, in "<path>.idx".
+ */
+typedef struct Row_Index {
+    u64 magic;
+    u64 version;
+    Cache_Key key;
+    u64 stride;
+    u64 rows;         // data rows in the file
+    u64 header_begin; // after leading blank lines
+    u64 header_end;   // first byte of the first data row
+    CSV_Dialect dialect;
+    u64 count;        // entries in offsets
+} Row_Index;
+
+static char *row_index_path(const char *content)
+{
+    size_t length = strlen(content);
+    char *path = malloc(length + sizeof(ROW_INDEX_SUFFIX));
+    if (path)
+    {
+        memcpy(path, content, length);
+        memcpy(path + length, ROW_INDEX_SUFFIX, sizeof(ROW_INDEX_SUFFIX));
+    }
+    return path;
+}
+
+/*
+ * Scans every record boundary of a file, quotes included, without splitting
+ * any field.
+ * @return: The offsets, allocated in arena, NULL on failure.
+ */
+static u64 *build_row_index(const char *content, CSV_Dialect dialect, Arena *arena, Row_Index *index)
+{
+    CSV file;
+    init_csv(&file);
+    u8 *begin = map_file(content, &file, FALSE);
+    if (!begin)
+    {
+        return NULL;
+    }
+    u8 *end = begin + file.mapping_size;
+    madvise(begin, file.mapping_size, MADV_SEQUENTIAL);
+
+    u8 *current = begin;
+    while (current < end && (*current == '\n' || *current == '\r'))
+    {
+        current++;
+    }
+    index->header_begin = current - begin;
+    index->dialect = dialect.delimiter ? dialect : sniff_dialect(current, end - current);
+
+    u64 capacity = ROWS_INITIAL_CAPACITY;
+    u64 *offsets = arena_alloc(arena, sizeof(u64) * capacity);
+    if (!offsets)
+    {
+        set_error(ERR_MEM_ALLOC);
+        deinit_csv(&file);
+        return NULL;
+    }
+
+    Scanner scanner;
+    u8 *pos;
+    boolean is_newline = FALSE;
+    scanner_init(&scanner, current, end, &index->dialect);
+    while (!is_newline && scanner_next(&scanner, &pos, &is_newline))
+    {
+    }
+    current = is_newline ? pos + 1 : end;
+    index->header_end = current - begin;
+
+    u64 rows = 0;
+    while (current < end)
+    {
+        if (rows % index->stride == 0)
+        {
+            u64 entry = rows / index->stride;
+            if (entry == capacity)
+            {
+                offsets = arena_realloc(arena, offsets, sizeof(u64) * capacity, sizeof(u64) * capacity * 2);
+                if (!offsets)
+                {
+                    set_error(ERR_MEM_ALLOC);
+                    deinit_csv(&file);
+                    return NULL;
+                }
+                capacity *= 2;
+            }
+            offsets[entry] = current - begin;
+        }
+        rows++;
+        current = scanner_next_record(&scanner, &pos) ? pos + 1 : end;
+    }
+
+    index->rows = rows;
+    index->count = (rows + index->stride - 1) / index->stride;
+    deinit_csv(&file);
+    return offsets;
+}
+
+static s32 write_row_index(const char *path, const Row_Index *index, const u64 *offsets)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        set_error(ERR_OPEN_FILE);
+        return 0;
+    }
+    s32 ok = fwrite(index, sizeof(*index), 1, file) == 1 && fwrite(offsets, sizeof(u64), index->count, file) == index->count;
+    if (fclose(file) != 0 || !ok)
+    {
+        set_error(ERR_WRITE_FILE);
+        remove(path);
+        return 0;
+    }
+    return 1;
+}
+
+// Whether the fields of a row index read from disk describe the file of key
+static boolean row_index_valid(const Row_Index *index, const Cache_Key *key)
+{
+    return index->magic == ROW_INDEX_MAGIC && index->version == CACHE_VERSION &&
+           memcmp(&index->key, key, sizeof(*key)) == 0 && index->stride != 0 && index->rows <= key->size &&
+           index->count == index->rows / index->stride + (index->rows % index->stride != 0) &&
+           index->header_begin <= index->header_end && index->header_end <= key->size &&
+           index->dialect.delimiter != 0;
+}
+
+/*
+ * Reads a row index if it exists, matches key and was built for the
+ * delimiter and quote of dialect, when set, without throwing errors.
+ * @return: The offsets, allocated in arena, NULL if there is no usable index.
+ */
+static u64 *read_row_index(const char *path, const Cache_Key *key, CSV_Dialect dialect, Arena *arena, Row_Index *index)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    u64 *offsets = NULL;
+    if (fread(index, sizeof(*index), 1, file) == 1 && row_index_valid(index, key) &&
+        (dialect.delimiter == 0 || (dialect.delimiter == index->dialect.delimiter && dialect.quote == index->dialect.quote)))
+    {
+        offsets = arena_alloc(arena, sizeof(u64) * index->count + 1);
+        if (offsets && fread(offsets, sizeof(u64), index->count, file) != index->count)
+        {
+            offsets = NULL;
+        }
+        // Every entry starts a row of the body, after the previous one
+        for (u64 i = 0; offsets && i < index->count; i++)
+        {
+            u64 previous = i ? offsets[i - 1] + 1 : index->header_end;
+            if (offsets[i] < previous || offsets[i] >= key->size)
+            {
+                offsets = NULL;
+            }
+        }
+    }
+    fclose(file);
+    return offsets;
+}
+
+/*
+ * Reads the index next to content, building and saving it when it is
+ * missing, older than the file, corrupt or built for another dialect.
+ */
+static u64 *load_row_index(const char *content, CSV_Dialect dialect, Arena *arena, Row_Index *index)
+{
+    Cache_Key key;
+    if (!cache_key(content, &key))
+    {
+        return NULL;
+    }
+    char *path = row_index_path(content);
+    if (!path)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return NULL;
+    }
+
+    u64 *offsets = read_row_index(path, &key, dialect, arena, index);
+    if (!offsets)
+    {
+        *index = (Row_Index){ .magic = ROW_INDEX_MAGIC, .version = CACHE_VERSION, .key = key, .stride = ROW_INDEX_STRIDE };
+        offsets = build_row_index(content, dialect, arena, index);
+        if (offsets && !write_row_index(path, index, offsets))
+        {
+            offsets = NULL;
+        }
+    }
+    free(path);
+    return offsets;
+}
+
+void csv_build_row_index(const char *content)
+{
+    Arena arena = {0};
+    Row_Index index;
+    load_row_index(content, (CSV_Dialect){0}, &arena, &index);
+    arena_free(&arena);
+}
+
+void csv_read_rows(const char *content, u64 start, u64 count, CSV *csv)
+{
+    Row_Index index;
+    u64 *offsets = load_row_index(content, csv->dialect, &csv->allocator, &index);
+    if (!offsets)
     {
-        set_error(ERR_FILE_NOT_FOUND);
         goto defer;
     }
+    if (start >= index.rows)
+    {
+        set_error(ERR_CSV_OUT_OF_BOUNDS);
+        goto defer;
+    }
+    if (count > index.rows - start)
+    {
+        count = index.rows - start;
+    }
+
+    // Only the blocks holding [start, start + count) are read
+    u64 first = start / index.stride;
+    u64 last = (start + count + index.stride - 1) / index.stride;
+    u64 begin = offsets[first];
+    u64 end = last < index.count ? offsets[last] : index.key.size;
+    u64 header_size = index.header_end - index.header_begin;
+    u8 *header = arena_alloc(&csv->allocator, header_size + 1);
+    u8 *block = arena_alloc(&csv->allocator, end - begin + 1);
+    if (!header || !block)
+    {
+        set_error(ERR_MEM_ALLOC);
+        goto defer;
+    }
+    csv->text_size += header_size + 1 + end - begin + 1;
+
+    s32 fd = open(content, O_RDONLY);
+    if (fd == -1)
+    {
+        set_error(ERR_FILE_NOT_FOUND);
+        goto defer;
+    }
+    s32 ok = pread(fd, header, header_size, index.header_begin) == (ssize_t)header_size &&
+             pread(fd, block, end - begin, begin) == (ssize_t)(end - begin);
+    close(fd);
+    if (!ok)
+    {
+        set_error(ERR_READ_FILE);
+        goto defer;
+    }
+
+    if (csv->dialect.delimiter == 0)
+    {
+        csv->dialect = index.dialect;
+    }
+    Scanner scanner;
+    u8 *current = header;
+    scanner_init(&scanner, header, header + header_size, &csv->dialect);
+    if (!parse_header(csv, &scanner, &current))
+    {
+        goto defer;
+    }
+
+    scanner_init(&scanner, block, block + (end - begin), &csv->dialect);
+    current = block;
+    for (u64 row = first * index.stride; row < start; row++)
+    {
+        u8 *pos;
+        boolean is_newline = FALSE;
+        while (!is_newline && scanner_next(&scanner, &pos, &is_newline))
+        {
+        }
+        current = is_newline ? pos + 1 : scanner.end;
+    }
+
+    Parsed_Rows parsed;
+    if (!parsed_rows_config(csv, &parsed))
+    {
+        goto defer;
+    }
+    parsed.max_rows = count;
+    if (!parsed_rows_init(&csv->allocator, &parsed) || !parse_rows(&csv->allocator, &scanner, current, &parsed))
+    {
+        set_error(ERR_MEM_ALLOC);
+        goto defer;
+    }
+    if (!store_parsed(csv, &parsed) || !finish_load(csv))
+    {
+        goto defer;
+    }
+    return;
+
+defer:
+    arena_free(&csv->allocator);
+}
+
+// End Row Index
+
+// Begin Decompression
+
+/*
+ * Bytes of a file, decompressed if its magic bytes say so. Compressed input
+ * is decoded on its own thread into a ring of PIPELINE_BUFFERS chunks, so it
+ * overlaps with the parse of the chunks before. Plain input is read as is.
+ */
+struct Decode_Stream {
+    FILE *file;
+    Compression format;
+    u8 *input;          // compressed bytes read but not decoded yet
+    u64 input_size;
+    u64 input_pos;
+    boolean input_eof;
+    boolean frame_open; // the input ended in the middle of a frame if still set
+#ifdef CSV_WITH_ZLIB
+    z_stream gzip;
+#endif
+#ifdef CSV_WITH_ZSTD
+    ZSTD_DCtx *zstd;
+#endif
+    boolean threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    u8 *ring[PIPELINE_BUFFERS];
+    u64 sizes[PIPELINE_BUFFERS];
+    u64 head;   // chunks consumed
+    u64 tail;   // chunks decoded
+    u64 offset; // bytes consumed in the head chunk
+    boolean done;
+    boolean cancel;
+    ERRNO error;
+};
+
+static s32 stream_refill(Decode_Stream *s)
+{
+    s->input_pos = 0;
+    s->input_size = fread(s->input, 1, DECODE_INPUT_SIZE, s->file);
+    if (s->input_size < DECODE_INPUT_SIZE)
+    {
+        if (ferror(s->file))
+        {
+            s->error = ERR_READ_FILE;
+            return 0;
+        }
+        s->input_eof = TRUE;
+    }
+    return 1;
+}
+
+#ifdef CSV_WITH_ZLIB
+static s64 decode_gzip(Decode_Stream *s, u8 *out, u64 size)
+{
+    u64 produced = 0;
+    while (produced < size)
+    {
+        if (s->input_pos == s->input_size)
+        {
+            if (s->input_eof)
+            {
+                break;
+            }
+            if (!stream_refill(s))
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        s->gzip.next_in = s->input + s->input_pos;
+        s->gzip.avail_in = s->input_size - s->input_pos;
+        s->gzip.next_out = out + produced;
+        s->gzip.avail_out = size - produced;
+        s32 status = inflate(&s->gzip, Z_NO_FLUSH);
+        s->input_pos = s->input_size - s->gzip.avail_in;
+        produced = size - s->gzip.avail_out;
+        s->frame_open = TRUE;
+        if (status == Z_STREAM_END)
+        {
+            // Concatenated members are decoded one after the other
+            s->frame_open = FALSE;
+            inflateReset(&s->gzip);
+        }
+        else if (status != Z_OK && status != Z_BUF_ERROR)
+        {
+            s->error = ERR_COMPRESSION;
+            return -1;
+        }
+    }
+    return produced;
+}
+#endif
+
+#ifdef CSV_WITH_ZSTD
+static s64 decode_zstd(Decode_Stream *s, u8 *out, u64 size)
+{
+    ZSTD_outBuffer output = { .dst = out, .size = size, .pos = 0 };
+    while (output.pos < output.size)
+    {
+        if (s->input_pos == s->input_size && !s->input_eof)
+        {
+            if (!stream_refill(s))
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        // At the end of the file the input is empty, which flushes what the
+        // context still holds until it stops making progress
+        ZSTD_inBuffer input = { .src = s->input + s->input_pos, .size = s->input_size - s->input_pos, .pos = 0 };
+        size_t produced = output.pos;
+        size_t status = ZSTD_decompressStream(s->zstd, &output, &input);
+        s->input_pos += input.pos;
+        if (ZSTD_isError(status))
+        {
+            s->error = ERR_COMPRESSION;
+            return -1;
+        }
+        if (input.size == 0 && output.pos == produced)
+        {
+            // Nothing left, the status only hints at the size of a next frame
+            break;
+        }
+        s->frame_open = status != 0;
+    }
+    return output.pos;
+}
+#endif
+
+/*
+ * Decodes up to size bytes, fewer only at the end of the file.
+ * @return: Bytes decoded, -1 on failure with s->error set.
+ */
+static s64 stream_decode(Decode_Stream *s, u8 *out, u64 size)
+{
+    s64 got = -1;
+    switch (s->format)
+    {
+#ifdef CSV_WITH_ZLIB
+        case COMPRESSION_GZIP:
+            got = decode_gzip(s, out, size);
+            break;
+#endif
+#ifdef CSV_WITH_ZSTD
+        case COMPRESSION_ZSTD:
+            got = decode_zstd(s, out, size);
+            break;
+#endif
+        default:
+            s->error = ERR_COMPRESSION;
+            break;
+    }
+    if (got >= 0 && (u64)got < size && s->frame_open)
+    {
+        // Truncated file
+        s->error = ERR_COMPRESSION;
+        return -1;
+    }
+    return got;
+}
+
+static void *stream_decode_worker(void *arg)
+{
+    Decode_Stream *s = arg;
+    boolean done = FALSE;
+    while (!done)
+    {
+        pthread_mutex_lock(&s->lock);
+        while (s->tail - s->head == PIPELINE_BUFFERS && !s->cancel)
+        {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        boolean cancel = s->cancel;
+        u64 slot = s->tail % PIPELINE_BUFFERS;
+        pthread_mutex_unlock(&s->lock);
+        if (cancel)
+        {
+            break;
+        }
+
+        s64 got = stream_decode(s, s->ring[slot], READER_CHUNK_SIZE);
+        done = got < READER_CHUNK_SIZE;
+
+        pthread_mutex_lock(&s->lock);
+        if (got > 0)
+        {
+            s->sizes[slot] = got;
+            s->tail++;
+        }
+        s->done = done;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+    return NULL;
+}
+
+static void stream_close(Decode_Stream *s)
+{
+    if (!s)
+    {
+        return;
+    }
+
+    if (s->threaded)
+    {
+        pthread_mutex_lock(&s->lock);
+        s->cancel = TRUE;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->thread, NULL);
+        pthread_cond_destroy(&s->cond);
+        pthread_mutex_destroy(&s->lock);
+    }
+    for (u32 i = 0; i < PIPELINE_BUFFERS; i++)
+    {
+        free(s->ring[i]);
+    }
+#ifdef CSV_WITH_ZLIB
+    if (s->format == COMPRESSION_GZIP)
+    {
+        inflateEnd(&s->gzip);
+    }
+#endif
+#ifdef CSV_WITH_ZSTD
+    ZSTD_freeDCtx(s->zstd);
+#endif
+    if (s->file)
+    {
+        fclose(s->file);
+    }
+    free(s->input);
+    free(s);
+}
+
+/*
+ * Opens a file and detects its compression from its first bytes.
+ * @return: The stream, NULL on failure, the error is already set.
+ */
+static Decode_Stream *stream_open(const char *content)
+{
+    Decode_Stream *s = calloc(1, sizeof(Decode_Stream));
+    if (!s || !(s->input = malloc(DECODE_INPUT_SIZE)))
+    {
+        set_error(ERR_MEM_ALLOC);
+        free(s);
+        return NULL;
+    }
+
+    s->file = fopen(content, "rb");
+    if (!s->file)
+    {
+        set_error(ERR_FILE_NOT_FOUND);
+        stream_close(s);
+        return NULL;
+    }
+    if (!stream_refill(s))
+    {
+        set_error(s->error);
+        stream_close(s);
+        return NULL;
+    }
+
+    s->format = detect_compression(s->input, s->input_size);
+    s32 ok = 1;
+    switch (s->format)
+    {
+        case COMPRESSION_NONE:
+            return s;
+#ifdef CSV_WITH_ZLIB
+        case COMPRESSION_GZIP:
+            // 32 lets zlib accept both gzip and zlib headers
+            ok = inflateInit2(&s->gzip, 15 + 32) == Z_OK;
+            break;
+#endif
+#ifdef CSV_WITH_ZSTD
+        case COMPRESSION_ZSTD:
+            s->zstd = ZSTD_createDCtx();
+            ok = s->zstd != NULL;
+            break;
+#endif
+        default:
+            // Built without support for this format
+            ok = 0;
+            break;
+    }
+    if (!ok)
+    {
+        s->format = COMPRESSION_NONE;
+        set_error(ERR_COMPRESSION);
+        stream_close(s);
+        return NULL;
+    }
+
+    for (u32 i = 0; i < PIPELINE_BUFFERS; i++)
+    {
+        s->ring[i] = malloc(READER_CHUNK_SIZE);
+        if (!s->ring[i])
+        {
+            set_error(ERR_MEM_ALLOC);
+            stream_close(s);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->threaded = pthread_create(&s->thread, NULL, stream_decode_worker, s) == 0;
+    if (!s->threaded)
+    {
+        // No thread to overlap with, decode on demand
+        pthread_cond_destroy(&s->cond);
+        pthread_mutex_destroy(&s->lock);
+    }
+    return s;
+}
+
+/*
+ * Reads up to size decompressed bytes, fewer only at the end of the file.
+ * @return: Bytes read, -1 on failure, the error is already set.
+ */
+static s64 stream_read(Decode_Stream *s, u8 *out, u64 size)
+{
+    if (s->format == COMPRESSION_NONE || !s->threaded)
+    {
+        u64 copied = 0;
+        if (s->format == COMPRESSION_NONE)
+        {
+            // Bytes read to detect the format come first
+            copied = s->input_size - s->input_pos < size ? s->input_size - s->input_pos : size;
+            memcpy(out, s->input + s->input_pos, copied);
+            s->input_pos += copied;
+            copied += fread(out + copied, 1, size - copied, s->file);
+            if (copied < size && ferror(s->file))
+            {
+                set_error(ERR_READ_FILE);
+                return -1;
+            }
+            return copied;
+        }
+
+        s64 got = stream_decode(s, out, size);
+        if (got < 0)
+        {
+            set_error(s->error);
+        }
+        return got;
+    }
+
+    u64 copied = 0;
+    while (copied < size)
+    {
+        pthread_mutex_lock(&s->lock);
+        while (s->head == s->tail && !s->done)
+        {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        boolean empty = s->head == s->tail;
+        pthread_mutex_unlock(&s->lock);
+        if (empty)
+        {
+            break;
+        }
+
+        u64 slot = s->head % PIPELINE_BUFFERS;
+        u64 available = s->sizes[slot] - s->offset;
+        u64 n = available < size - copied ? available : size - copied;
+        memcpy(out + copied, s->ring[slot] + s->offset, n);
+        copied += n;
+        s->offset += n;
+        if (s->offset == s->sizes[slot])
+        {
+            pthread_mutex_lock(&s->lock);
+            s->head++;
+            s->offset = 0;
+            pthread_cond_broadcast(&s->cond);
+            pthread_mutex_unlock(&s->lock);
+        }
+    }
+
+    if (copied < size)
+    {
+        pthread_mutex_lock(&s->lock);
+        ERRNO error = s->error;
+        pthread_mutex_unlock(&s->lock);
+        if (error != NIL)
+        {
+            set_error(error);
+            return -1;
+        }
+    }
+    return copied;
+}
+
+/*
+ * Loads a whole compressed file through a single batch of the streaming
+ * reader: every chunk is parsed as soon as it is decompressed.
+ * @return s32: 0 on failure, the error is already set.
+ */
+static s32 load_compressed(const char *content, CSV *csv)
+{
+    CSV_Reader reader;
+    csv_reader_open(content, &reader, UINT64_MAX);
+    if (!reader.source)
+    {
+        return 0;
+    }
+    CSV *loaded = &reader.csv;
+    loaded->dialect = csv->dialect;
+    loaded->layout = csv->layout;
+    loaded->sampling = csv->sampling;
+    loaded->filter = csv->filter;
+    loaded->allocator.backing = csv->allocator.backing;
+
+    if (!csv_reader_next_batch(&reader))
+    {
+        if (get_error() != NIL)
+        {
+            csv_reader_close(&reader);
+            return 0;
+        }
+        // Only a header
+        loaded->rows_count = 1;
+    }
+
+    arena_adopt(&csv->allocator, &loaded->allocator);
+    arena_adopt(&csv->allocator, &reader.header_arena);
+    csv->cols_count = loaded->cols_count;
+    csv->rows_count = loaded->rows_count;
+    csv->type = loaded->type;
+    csv->header = loaded->header;
+    csv->rows = loaded->rows;
+    csv->columns = loaded->columns;
+    csv->dialect = loaded->dialect;
+    csv->types_sampled = loaded->types_sampled;
+    csv->text_size += loaded->text_size;
+    csv->hash_entries += loaded->hash_entries;
+    csv_reader_close(&reader);
+
+    if (csv->layout == CSV_LAYOUT_COLUMNS && !csv->columns)
+    {
+        csv->columns = arena_alloc(&csv->allocator, sizeof(String_View *) * csv->cols_count);
+        for (u64 col = 0; csv->columns && col < csv->cols_count; col++)
+        {
+            if (!(csv->columns[col] = arena_alloc(&csv->allocator, sizeof(String_View))))
+            {
+                csv->columns = NULL;
+            }
+        }
+        if (!csv->columns)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return 0;
+        }
+    }
+    return finish_load(csv);
+}
+
+// End Decompression
+
+// Begin Reader
+
+void csv_reader_open(const char *content, CSV_Reader *reader, u64 batch_rows)
+{
+    memset(reader, 0, sizeof(*reader));
+    init_csv(&reader->csv);
+    if (batch_rows == 0)
+    {
+        set_error(ERR_INVALID_ARG);
+        return;
+    }
+
+    reader->source = stream_open(content);
+    if (!reader->source)
+    {
+        return;
+    }
+    reader->batch_rows = batch_rows;
+}
+
+void csv_reader_close(CSV_Reader *reader)
+{
+    stream_close(reader->source);
+    arena_free(&reader->csv.allocator);
+    arena_free(&reader->csv.scratch);
+    arena_free(&reader->header_arena);
+    memset(reader, 0, sizeof(*reader));
+}
+
+/*
+ * Parses a copy of the header record [begin, begin + size) into header_arena,
+ * along with its hash entries, so it outlives the buffer it was read from.
+ * @return s32: 0 on failure, the error is already set.
+ */
+static s32 copy_header(CSV *csv, Arena *header_arena, const u8 *begin, u64 size)
+{
+    u8 *header = arena_alloc(header_arena, size + 1);
+    if (!header)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+    memcpy(header, begin, size);
+
+    Arena allocator = csv->allocator;
+    csv->allocator = *header_arena;
+    Scanner scanner;
+    u8 *current = header;
+    scanner_init(&scanner, header, header + size, &csv->dialect);
+    s32 ok = parse_header(csv, &scanner, &current);
+    *header_arena = csv->allocator;
+    csv->allocator = allocator;
+    return ok;
+}
+
+/*
+ * Reads more of the file into the carry buffer, doubling it when full.
+ * @return s32: 0 on failure, the error is already set.
+ */
+static s32 reader_read_carry(CSV_Reader *reader)
+{
+    if (reader->carry_size == reader->carry_capacity)
+    {
+        u64 capacity = reader->carry_capacity ? reader->carry_capacity * 2 : READER_CHUNK_SIZE;
+        u8 *carry = arena_realloc(&reader->header_arena, reader->carry, reader->carry_capacity, capacity);
+        if (!carry)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return 0;
+        }
+        reader->carry = carry;
+        reader->carry_capacity = capacity;
+    }
+
+    u64 wanted = reader->carry_capacity - reader->carry_size;
+    s64 got = stream_read(reader->source, reader->carry + reader->carry_size, wanted);
+    if (got < 0)
+    {
+        return 0;
+    }
+    reader->carry_size += got;
+    reader->eof = (u64)got < wanted;
+    return 1;
+}
+
+/*
+ * Reads until the header record is complete and copies it into the header
+ * arena, so it outlives every batch.
+ * @return s32: 0 on failure, the error is already set.
+ */
+static s32 reader_read_header(CSV_Reader *reader)
+{
+    CSV *csv = &reader->csv;
+    u64 start = 0;
+    u8 *header_end = NULL;
+    while (!header_end)
+    {
+        if (!reader_read_carry(reader))
+        {
+            return 0;
+        }
+
+        while (start < reader->carry_size && (reader->carry[start] == '\n' || reader->carry[start] == '\r'))
+        {
+            start++;
+        }
+        if (start == reader->carry_size && reader->eof)
+        {
+            set_error(ERR_CSV_EMPTY);
+            return 0;
+        }
+
+        if (csv->dialect.delimiter == 0 && (reader->eof || reader->carry_size - start >= SNIFF_SIZE))
+        {
+            csv->dialect = sniff_dialect(reader->carry + start, reader->carry_size - start);
+        }
+        if (csv->dialect.delimiter == 0)
+        {
+            continue;
+        }
+
+        Scanner scanner;
+        u8 *pos;
+        boolean is_newline = FALSE;
+        scanner_init(&scanner, reader->carry + start, reader->carry + reader->carry_size, &csv->dialect);
+        while (!is_newline && scanner_next(&scanner, &pos, &is_newline))
+        {
+        }
+
+        if (is_newline)
+        {
+            header_end = pos + 1;
+        }
+        else if (reader->eof)
+        {
+            header_end = reader->carry + reader->carry_size;
+        }
+    }
+
+    u64 header_size = header_end - (reader->carry + start);
+    if (!copy_header(csv, &reader->header_arena, reader->carry + start, header_size))
+    {
+        return 0;
+    }
+    csv->type = arena_alloc(&reader->header_arena, sizeof(ColumnType) * csv->cols_count);
+    reader->type_masks = arena_alloc(&reader->header_arena, csv->cols_count);
+    if (!csv->type || !reader->type_masks)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return 0;
+    }
+    memset(reader->type_masks, TYPE_MASK_ALL, csv->cols_count);
+    for (u64 col = 0; col < csv->cols_count; col++)
+    {
+        csv->type[col] = type_from_mask(TYPE_MASK_ALL);
+    }
+
+    reader->carry_offset = start + header_size;
+    return 1;
+}
+
+/*
+ * Moves the unparsed tail of a batch, from current to end, to the front of a
+ * block and fills the rest from the file. The block is the carry itself when
+ * no row of the batch points into it yet, a new one of the batch arena
+ * otherwise. Blocks keep a fixed size unless the tail, a single record cut
+ * by the end of the previous block, takes more than half of one.
+ * @return: The block, NULL on failure with the error already set.
+ */
+static u8 *reader_refill(CSV_Reader *reader, const u8 *current, u64 leftover_size, boolean keep_carry, u64 *size)
+{
+    u64 capacity = READER_CHUNK_SIZE;
+    if (leftover_size > capacity / 2)
+    {
+        capacity = leftover_size * 2;
+    }
+
+    u8 *block;
+    if (keep_carry)
+    {
+        block = arena_alloc(&reader->csv.allocator, capacity);
+        if (!block)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return NULL;
+        }
+        reader->csv.text_size += capacity;
+        memcpy(block, current, leftover_size);
+    }
+    else
+    {
+        memmove(reader->carry, current, leftover_size);
+        if (capacity > reader->carry_capacity)
+        {
+            block = arena_realloc(&reader->header_arena, reader->carry, reader->carry_capacity, capacity);
+            if (!block)
+            {
+                set_error(ERR_MEM_ALLOC);
+                return NULL;
+            }
+            reader->carry = block;
+            reader->carry_capacity = capacity;
+        }
+        block = reader->carry;
+        capacity = reader->carry_capacity;
+    }
+    *size = leftover_size;
+
+    if (!reader->eof)
+    {
+        u64 wanted = capacity - leftover_size;
+        s64 got = stream_read(reader->source, block + leftover_size, wanted);
+        if (got < 0)
+        {
+            return NULL;
+        }
+        *size += got;
+        reader->eof = (u64)got < wanted;
+    }
+    if (!keep_carry)
+    {
+        reader->carry_offset = 0;
+        reader->carry_size = *size;
+    }
+    return block;
+}
+
+CSV *csv_reader_next_batch(CSV_Reader *reader)
+{
+    if (!reader || !reader->source)
+    {
+        set_error(ERR_INVALID_ARG);
+        return NULL;
+    }
+
+    CSV *csv = &reader->csv;
+    if (!csv->header && !reader_read_header(reader))
+    {
+        return NULL;
+    }
+
+    arena_reset(&csv->allocator);
+    arena_reset(&csv->scratch);
+    invalidate_typed_columns(csv);
+    csv->text_size = 0;
+    csv->rows = NULL;
+    csv->columns = NULL;
+    csv->rows_count = 0;
+    if (reader->eof && reader->carry_offset == reader->carry_size)
+    {
+        return NULL;
+    }
+
+    // Rows already read are parsed before reading more
+    boolean in_carry = TRUE;
+    u8 *current = reader->carry + reader->carry_offset;
+    u8 *end = reader->carry + reader->carry_size;
+
+    Parsed_Rows parsed;
+    if (!parsed_rows_config(csv, &parsed))
+    {
+        return NULL;
+    }
+    parsed.max_rows = reader->batch_rows;
+    parsed.rng = reader->batches + 1;
+    if (!parsed_rows_init(&csv->allocator, &parsed))
+    {
+        set_error(ERR_MEM_ALLOC);
+        return NULL;
+    }
+
+    while (TRUE)
+    {
+        parsed.partial_tail = !reader->eof;
+        Scanner scanner;
+        scanner_init(&scanner, current, end, &csv->dialect);
+        current = parse_rows(&csv->allocator, &scanner, current, &parsed);
+        if (!current)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return NULL;
+        }
+        if (current > end)
+        {
+            current = end;
+        }
+
+        if (parsed.count == reader->batch_rows || reader->eof)
+        {
+            break;
+        }
+
+        // Rows parsed so far keep pointing into their block, so the carry
+        // is only reused while the batch has none
+        u64 size;
+        in_carry = parsed.count == 0;
+        current = reader_refill(reader, current, end - current, !in_carry, &size);
+        if (!current)
+        {
+            return NULL;
+        }
+        end = current + size;
+    }
+
+    if (in_carry)
+    {
+        reader->carry_offset = current - reader->carry;
+    }
+    else if (current == end)
+    {
+        reader->carry_offset = 0;
+        reader->carry_size = 0;
+    }
+    else
+    {
+        // The batch ended in a block of the arena. Its tail becomes the
+        // carry by way of the spare, as rows of the batch may still point
+        // into the current carry
+        if ((u64)(end - current) > reader->spare_capacity)
+        {
+            u8 *spare = arena_realloc(&reader->header_arena, reader->spare, reader->spare_capacity, end - current);
+            if (!spare)
+            {
+                set_error(ERR_MEM_ALLOC);
+                return NULL;
+            }
+            reader->spare = spare;
+            reader->spare_capacity = end - current;
+        }
+        memcpy(reader->spare, current, end - current);
+
+        u8 *carry = reader->carry;
+        u64 carry_capacity = reader->carry_capacity;
+        reader->carry = reader->spare;
+        reader->carry_capacity = reader->spare_capacity;
+        reader->spare = carry;
+        reader->spare_capacity = carry_capacity;
+        reader->carry_offset = 0;
+        reader->carry_size = end - current;
+    }
+
+    if (parsed.count == 0)
+    {
+        return NULL;
+    }
+
+    // Types are shared by every batch and only ever promoted
+    for (u64 col = 0; col < csv->cols_count; col++)
+    {
+        reader->type_masks[col] &= parsed.type_masks[col];
+        csv->type[col] = type_from_mask(reader->type_masks[col]);
+    }
+    csv->types_sampled = csv->sampling.head_rows != 0;
+
+    csv->rows = parsed.rows;
+    csv->columns = parsed.columns;
+    csv->rows_count = parsed.count + 1; // for header
+    if (csv->layout == CSV_LAYOUT_COLUMNS)
+    {
+        for (u64 col = 0; col < csv->cols_count; col++)
+        {
+            csv->columns[col][0] = csv->header[col];
+        }
+    }
+    reader->batches++;
+    return csv;
+}
 
-    fseek(file, 0, SEEK_END);
-    size_t file_size = ftell(file);
-    rewind(file);
+// End Reader
 
-    u8 *buffer = arena_alloc(&csv->allocator, file_size + 1);
-    if (!buffer)
+// Begin Push Parser
+
+void csv_parser_init(CSV_Parser *parser, Row_Callback on_row, void *user_data)
+{
+    memset(parser, 0, sizeof(*parser));
+    init_csv(&parser->csv);
+    parser->on_row = on_row;
+    parser->user_data = user_data;
+}
+
+void csv_parser_deinit(CSV_Parser *parser)
+{
+    arena_free(&parser->csv.allocator);
+    arena_free(&parser->csv.scratch);
+    arena_free(&parser->header_arena);
+    free(parser->pending);
+    memset(parser, 0, sizeof(*parser));
+}
+
+/*
+ * Parses the complete records in [pending, pending + size), the first one
+ * being the header if it has not been seen yet, and hands every row to the
+ * callback. Cells live in csv.allocator, which is reset afterwards.
+ * @return s32: 0 on failure, the error is already set.
+ */
+static s32 parser_emit(CSV_Parser *parser, u64 size)
+{
+    CSV *csv = &parser->csv;
+    u8 *current = parser->pending;
+    u8 *end = current + size;
+    Scanner scanner;
+    if (!csv->header)
+    {
+        u8 *pos = end;
+        boolean is_newline = FALSE;
+        scanner_init(&scanner, current, end, &csv->dialect);
+        while (!is_newline && scanner_next(&scanner, &pos, &is_newline))
+        {
+        }
+        u64 header_size = is_newline ? (u64)(pos + 1 - current) : size;
+        if (!copy_header(csv, &parser->header_arena, current, header_size))
+        {
+            return 0;
+        }
+        current += header_size;
+        csv->rows_count = 1;
+    }
+
+    String_View *cells = arena_alloc(&csv->allocator, sizeof(String_View) * csv->cols_count);
+    if (!cells)
     {
         set_error(ERR_MEM_ALLOC);
-        goto defer;
+        return 0;
     }
-    
+    scanner_init(&scanner, current, end, &csv->dialect);
+    while (current < end)
+    {
+        for (u64 col = 0; col < csv->cols_count; col++)
+        {
+            cells[col].data = NULL;
+            cells[col].size = 0;
+        }
+        current = split_record(&csv->allocator, &scanner, current, cells, csv->cols_count);
+        if (!current)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return 0;
+        }
+        csv->rows_count++;
+        parser->on_row(csv, cells, parser->user_data);
+    }
+    arena_reset(&csv->allocator);
+    arena_reset(&csv->scratch);
+    return 1;
+}
 
-    fread(buffer, 1, file_size, file);
-    buffer[file_size] = '\0';
+/*
+ * Drops leading blank lines and sniffs the dialect once enough bytes are
+ * buffered, or at the end of the input.
+ * @return boolean: Whether records can be searched for.
+ */
+static boolean parser_ready(CSV_Parser *parser, boolean at_end)
+{
+    CSV *csv = &parser->csv;
+    if (!csv->header)
+    {
+        u64 start = 0;
+        while (start < parser->pending_size && (parser->pending[start] == '\n' || parser->pending[start] == '\r'))
+        {
+            start++;
+        }
+        parser->pending_size -= start;
+        memmove(parser->pending, parser->pending + start, parser->pending_size);
+        parser->scanned = 0;
+        parser->quotes = 0;
+    }
 
-    csv->rows_count = count_rows_from_buffer(buffer);
-    csv->cols_count = count_columns_from_buffer(buffer);
+    if (csv->dialect.delimiter == 0 && parser->pending_size > 0 && (at_end || parser->pending_size >= SNIFF_SIZE))
+    {
+        csv->dialect = sniff_dialect(parser->pending, parser->pending_size);
+    }
+    return csv->dialect.delimiter != 0;
+}
 
-    if (!parse_header(csv, buffer))
+void csv_parser_feed(CSV_Parser *parser, const u8 *bytes, u64 len)
+{
+    if (!parser || !parser->on_row || (!bytes && len))
     {
-        goto defer;
+        set_error(ERR_INVALID_ARG);
+        return;
     }
 
-    while (*buffer && *buffer != '\n')
+    if (parser->pending_size + len > parser->pending_capacity)
     {
-        buffer++;
+        u64 capacity = parser->pending_capacity ? parser->pending_capacity : SNIFF_SIZE;
+        while (capacity < parser->pending_size + len)
+        {
+            capacity *= 2;
+        }
+        u8 *pending = realloc(parser->pending, capacity);
+        if (!pending)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return;
+        }
+        parser->pending = pending;
+        parser->pending_capacity = capacity;
     }
-    buffer++;
-    
-    if (!parse(csv, buffer))
+    memcpy(parser->pending + parser->pending_size, bytes, len);
+    parser->pending_size += len;
+
+    if (!parser_ready(parser, FALSE))
     {
-        goto defer;
+        return;
+    }
+
+    // Only the bytes not searched by a previous call are scanned, the quote
+    // parity of the ones before tells whether they start inside a field
+    u8 *begin = parser->pending + parser->scanned;
+    u8 *end = parser->pending + parser->pending_size;
+    u8 *last_newline = NULL;
+    u8 *pos;
+    boolean is_newline;
+    Scanner scanner;
+    scanner_init_at(&scanner, begin, end, &parser->csv.dialect, parser->quotes & 1);
+    while (scanner_next(&scanner, &pos, &is_newline))
+    {
+        if (is_newline)
+        {
+            last_newline = pos;
+        }
     }
 
+    if (!last_newline)
+    {
+        parser->quotes += count_quotes(begin, end, &parser->csv.dialect);
+        parser->scanned = parser->pending_size;
+        return;
+    }
 
-    csv->type = (ColumnType *)arena_alloc(&csv->allocator, sizeof(ColumnType) * csv->cols_count);
-    if (!csv->type)
+    u64 complete = last_newline + 1 - parser->pending;
+    if (!parser_emit(parser, complete))
     {
-        set_error(ERR_MEM_ALLOC);
-        goto defer;
+        return;
     }
+    parser->pending_size -= complete;
+    memmove(parser->pending, parser->pending + complete, parser->pending_size);
+    parser->quotes = count_quotes(parser->pending, parser->pending + parser->pending_size, &parser->csv.dialect);
+    parser->scanned = parser->pending_size;
+}
 
-    for (size_t col = 0; col < csv->cols_count; col++)
+void csv_parser_finish(CSV_Parser *parser)
+{
+    if (!parser || !parser->on_row)
     {
-        detect_column_type(csv, col);
+        set_error(ERR_INVALID_ARG);
+        return;
     }
-    
-    fclose(file);
-    return;
 
-defer:
-    if (file)
+    if (!parser_ready(parser, TRUE))
     {
-        fclose(file);
+        if (!parser->csv.header)
+        {
+            set_error(ERR_CSV_EMPTY);
+        }
+        return;
     }
 
-    if (buffer)
+    // The last record may lack its newline
+    if (parser->pending_size > 0 && parser_emit(parser, parser->pending_size))
     {
-        arena_free(&csv->allocator);
+        parser->pending_size = 0;
+        parser->scanned = 0;
+        parser->quotes = 0;
     }
-    return;
 }
 
+// End Push Parser
+
 void save_csv(const char *output_file, CSV *csv)
 {
     if (!csv)
@@ -565,14 +4986,15 @@ void save_csv(const char *output_file, CSV *csv)
     {
         for (s64 col = 0; col < get_col_count(csv); col++)
         {
-            size_t len = csv->rows[row].cells[col].size;
+            String_View *cell = cell_at(csv, row, col);
+            size_t len = cell->size;
             if (buf_len + len + 2 >= BUFFER_SIZE)
             {
                 fwrite(buffer, 1, buf_len, target);
                 buf_len = 0;
             }
 
-            memcpy(buffer + buf_len, csv->rows[row].cells[col].data, len);
+            memcpy(buffer + buf_len, cell->data, len);
             buf_len += len;
             buffer[buf_len++] = (col == get_col_count(csv) - 1) ? '\n' : ',';
         }
@@ -615,19 +5037,20 @@ void print_csv(CSV *csv)
     {
         for (size_t col = 0; col < csv->cols_count; col++)
         {
+            String_View *cell = cell_at(csv, row, col);
             switch (csv->type[col])
             {
                 case CSV_TYPE_INTEGER:
-                    printf("%-15d", *((int*)csv->rows[row].cells[col].data));
+                    printf("%-15d", *((int*)cell->data));
                     break;
                 case CSV_TYPE_FLOAT:
-                    printf("%-15.4f", *((float*)csv->rows[row].cells[col].data));
+                    printf("%-15.4f", *((float*)cell->data));
                     break;
                 case CSV_TYPE_BOOLEAN:
-                    printf("%-15s", *((int*)csv->rows[row].cells[col].data) ? "True" : "False");
+                    printf("%-15s", *((int*)cell->data) ? "True" : "False");
                     break;
                 case CSV_TYPE_STRING:
-                    printf("%-15.*s", (int)csv->rows[row].cells[col].size, csv->rows[row].cells[col].data);
+                    printf("%-15.*s", (int)cell->size, cell->data);
                     break;
                 default:
                     printf("%-15s", "UNKNOWN");
@@ -638,148 +5061,549 @@ void print_csv(CSV *csv)
     }
 }
 
-void print_column(const String_View *column, u64 rows)
+void print_column(const String_View *column, u64 rows)
+{
+    if (!column)
+    {
+        set_error(ERR_INVALID_ARG);
+        return;
+    }
+
+    for (u64 row = 0; row < rows; row++)
+    {
+        printf(sv_fmt"\n", sv_args(column[row]));
+    }
+}
+
+void fillna(CSV *csv)
+{
+    if (!csv || is_csv_empty(csv))
+    {
+        set_error(ERR_CSV_EMPTY);
+        return;
+    }
+
+    for (s64 row = 0; row < csv->rows_count - 1; row++)
+    {
+        for (s64 col = 0; col < csv->cols_count; col++)
+        {
+            String_View *cell = cell_at(csv, row, col);
+            if (cell->size == 0 || cell->data == NULL)
+            {
+                if (csv->type[col] == CSV_TYPE_FLOAT || csv->type[col] ==  CSV_TYPE_INTEGER)
+                {
+                    cell->data = "NaN";
+                    cell->size = 3;
+                } 
+                else 
+                {
+                    cell->data = "None";
+                    cell->size = 4;
+                }
+            }
+        }
+    }
+}
+
+CSV dropna(CSV *input_csv)
+{   
+    if (!input_csv || is_csv_empty(input_csv))
+    {
+        set_error(ERR_CSV_EMPTY);
+        return (CSV){0};
+    }
+
+    u64 valid_rows = 0;
+    for (u64 row = 0; row < get_row_count(input_csv) - 1; row++)
+    {
+        boolean empty = FALSE;
+        for (u64 col = 0; col < get_col_count(input_csv); col++)
+        {
+            if (is_cell_empty(*cell_at(input_csv, row, col)))
+            {
+                empty = TRUE;
+                break;
+            }
+        }
+
+        if (!empty)
+        {
+            valid_rows++;
+        }
+    }
+    
+    if (valid_rows == get_row_count(input_csv) - 1)
+    {
+        return (CSV){0};
+    }
+
+    CSV output_csv;
+    init_csv(&output_csv);
+    output_csv.cols_count = input_csv->cols_count;
+    output_csv.rows_count = valid_rows;
+    output_csv.type = input_csv->type;
+    output_csv.header = arena_alloc(&output_csv.allocator, input_csv->cols_count * sizeof(String_View));
+    if (!output_csv.header)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return (CSV){0};
+    }
+    memcpy(output_csv.header, input_csv->header, input_csv->cols_count * sizeof(String_View));
+    output_csv.layout = input_csv->layout;
+    if (output_csv.layout == CSV_LAYOUT_COLUMNS)
+    {
+        output_csv.columns = arena_alloc(&output_csv.allocator, input_csv->cols_count * sizeof(String_View *));
+        for (u64 col = 0; output_csv.columns && col < input_csv->cols_count; col++)
+        {
+            output_csv.columns[col] = arena_alloc(&output_csv.allocator, (valid_rows + 1) * sizeof(String_View));
+            if (!output_csv.columns[col])
+            {
+                output_csv.columns = NULL;
+                break;
+            }
+            output_csv.columns[col][0] = input_csv->header[col];
+        }
+
+        if (!output_csv.columns)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return (CSV){0};
+        }
+    }
+    else
+    {
+        output_csv.rows = arena_alloc(&output_csv.allocator, valid_rows * sizeof(Row));
+        if (!output_csv.rows)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return (CSV){0};
+        }
+    }
+
+    u64 new_row = 0;
+    for (u64 row = 0; row < get_row_count(input_csv) - 1; row++)
+    {
+        boolean empty = FALSE;
+        for (u64 col = 0; col < get_col_count(input_csv); col++)
+        {
+            if (is_cell_empty(*cell_at(input_csv, row, col)))
+            {
+                empty = TRUE;
+                break;
+            }
+        }
+
+        if (!empty && output_csv.layout == CSV_LAYOUT_COLUMNS)
+        {
+            for (u64 col = 0; col < get_col_count(input_csv); col++)
+            {
+                output_csv.columns[col][new_row + 1] = *cell_at(input_csv, row, col);
+            }
+            new_row++;
+        }
+        else if (!empty)
+        {
+            output_csv.rows[new_row++] = input_csv->rows[row];
+        }
+    }
+    output_csv.rows_count++; // for header
+    return output_csv;
+}
+
+// Begin Number Parsing
+
+// Full 64x64 bit products, __extension__ keeps -pedantic quiet about the type
+__extension__ typedef unsigned __int128 u128;
+
+static inline boolean is_eight_digits(u64 chunk)
+{
+    return ((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+            (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+
+// Converts 8 ASCII digits (little-endian load) to their value with 3 multiplications
+static inline u32 parse_eight_digits(u64 chunk)
+{
+    const u64 mask = 0x000000FF000000FFULL;
+    const u64 mul1 = 100 + (1000000ULL << 32);
+    const u64 mul2 = 1 + (10000ULL << 32);
+    chunk -= 0x3030303030303030ULL;
+    chunk = (chunk * 10) + (chunk >> 8);
+    return (u32)((((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32);
+}
+
+/*
+ * Accumulates the digits at *p into *value, eight at a time while possible.
+ * @return: Number of digits consumed.
+ */
+static inline u64 accumulate_digits(const u8 **p, const u8 *end, u64 *value)
+{
+    const u8 *start = *p;
+    while (end - *p >= 8)
+    {
+        u64 chunk;
+        memcpy(&chunk, *p, sizeof(chunk));
+        if (!is_eight_digits(chunk))
+        {
+            break;
+        }
+        *value = *value * 100000000ULL + parse_eight_digits(chunk);
+        *p += 8;
+    }
+    while (*p < end && (u8)(**p - '0') < 10)
+    {
+        *value = *value * 10 + (**p - '0');
+        (*p)++;
+    }
+    return *p - start;
+}
+
+// 128-bit truncations of 5^q for CSV_POW5_MIN <= q <= CSV_POW5_MAX, most significant bit set
+#define CSV_POW5_MIN (-64)
+#define CSV_POW5_MAX 64
+static const u64 power_of_five_128[][2] = {
+    { 0xa87fea27a539e9a5ULL, 0x3f2398d747b36224ULL }, // 5^-64
+    { 0xd29fe4b18e88640eULL, 0x8eec7f0d19a03aadULL }, // 5^-63
+    { 0x83a3eeeef9153e89ULL, 0x1953cf68300424acULL }, // 5^-62
+    { 0xa48ceaaab75a8e2bULL, 0x5fa8c3423c052dd7ULL }, // 5^-61
+    { 0xcdb02555653131b6ULL, 0x3792f412cb06794dULL }, // 5^-60
+    { 0x808e17555f3ebf11ULL, 0xe2bbd88bbee40bd0ULL }, // 5^-59
+    { 0xa0b19d2ab70e6ed6ULL, 0x5b6aceaeae9d0ec4ULL }, // 5^-58
+    { 0xc8de047564d20a8bULL, 0xf245825a5a445275ULL }, // 5^-57
+    { 0xfb158592be068d2eULL, 0xeed6e2f0f0d56712ULL }, // 5^-56
+    { 0x9ced737bb6c4183dULL, 0x55464dd69685606bULL }, // 5^-55
+    { 0xc428d05aa4751e4cULL, 0xaa97e14c3c26b886ULL }, // 5^-54
+    { 0xf53304714d9265dfULL, 0xd53dd99f4b3066a8ULL }, // 5^-53
+    { 0x993fe2c6d07b7fabULL, 0xe546a8038efe4029ULL }, // 5^-52
+    { 0xbf8fdb78849a5f96ULL, 0xde98520472bdd033ULL }, // 5^-51
+    { 0xef73d256a5c0f77cULL, 0x963e66858f6d4440ULL }, // 5^-50
+    { 0x95a8637627989aadULL, 0xdde7001379a44aa8ULL }, // 5^-49
+    { 0xbb127c53b17ec159ULL, 0x5560c018580d5d52ULL }, // 5^-48
+    { 0xe9d71b689dde71afULL, 0xaab8f01e6e10b4a6ULL }, // 5^-47
+    { 0x9226712162ab070dULL, 0xcab3961304ca70e8ULL }, // 5^-46
+    { 0xb6b00d69bb55c8d1ULL, 0x3d607b97c5fd0d22ULL }, // 5^-45
+    { 0xe45c10c42a2b3b05ULL, 0x8cb89a7db77c506aULL }, // 5^-44
+    { 0x8eb98a7a9a5b04e3ULL, 0x77f3608e92adb242ULL }, // 5^-43
+    { 0xb267ed1940f1c61cULL, 0x55f038b237591ed3ULL }, // 5^-42
+    { 0xdf01e85f912e37a3ULL, 0x6b6c46dec52f6688ULL }, // 5^-41
+    { 0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL }, // 5^-40
+    { 0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL }, // 5^-39
+    { 0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL }, // 5^-38
+    { 0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL }, // 5^-37
+    { 0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL }, // 5^-36
+    { 0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL }, // 5^-35
+    { 0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL }, // 5^-34
+    { 0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL }, // 5^-33
+    { 0xcfb11ead453994baULL, 0x67de18eda5814af2ULL }, // 5^-32
+    { 0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL }, // 5^-31
+    { 0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL }, // 5^-30
+    { 0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL }, // 5^-29
+    { 0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL }, // 5^-28
+    { 0x9e74d1b791e07e48ULL, 0x775ea264cf55347eULL }, // 5^-27
+    { 0xc612062576589ddaULL, 0x95364afe032a819eULL }, // 5^-26
+    { 0xf79687aed3eec551ULL, 0x3a83ddbd83f52205ULL }, // 5^-25
+    { 0x9abe14cd44753b52ULL, 0xc4926a9672793543ULL }, // 5^-24
+    { 0xc16d9a0095928a27ULL, 0x75b7053c0f178294ULL }, // 5^-23
+    { 0xf1c90080baf72cb1ULL, 0x5324c68b12dd6339ULL }, // 5^-22
+    { 0x971da05074da7beeULL, 0xd3f6fc16ebca5e04ULL }, // 5^-21
+    { 0xbce5086492111aeaULL, 0x88f4bb1ca6bcf585ULL }, // 5^-20
+    { 0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e6ULL }, // 5^-19
+    { 0x9392ee8e921d5d07ULL, 0x3aff322e62439fd0ULL }, // 5^-18
+    { 0xb877aa3236a4b449ULL, 0x09befeb9fad487c3ULL }, // 5^-17
+    { 0xe69594bec44de15bULL, 0x4c2ebe687989a9b4ULL }, // 5^-16
+    { 0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a11ULL }, // 5^-15
+    { 0xb424dc35095cd80fULL, 0x538484c19ef38c95ULL }, // 5^-14
+    { 0xe12e13424bb40e13ULL, 0x2865a5f206b06fbaULL }, // 5^-13
+    { 0x8cbccc096f5088cbULL, 0xf93f87b7442e45d4ULL }, // 5^-12
+    { 0xafebff0bcb24aafeULL, 0xf78f69a51539d749ULL }, // 5^-11
+    { 0xdbe6fecebdedd5beULL, 0xb573440e5a884d1cULL }, // 5^-10
+    { 0x89705f4136b4a597ULL, 0x31680a88f8953031ULL }, // 5^-9
+    { 0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3eULL }, // 5^-8
+    { 0xd6bf94d5e57a42bcULL, 0x3d32907604691b4dULL }, // 5^-7
+    { 0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b110ULL }, // 5^-6
+    { 0xa7c5ac471b478423ULL, 0x0fcf80dc33721d54ULL }, // 5^-5
+    { 0xd1b71758e219652bULL, 0xd3c36113404ea4a9ULL }, // 5^-4
+    { 0x83126e978d4fdf3bULL, 0x645a1cac083126eaULL }, // 5^-3
+    { 0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a4ULL }, // 5^-2
+    { 0xccccccccccccccccULL, 0xcccccccccccccccdULL }, // 5^-1
+    { 0x8000000000000000ULL, 0x0000000000000000ULL }, // 5^0
+    { 0xa000000000000000ULL, 0x0000000000000000ULL }, // 5^1
+    { 0xc800000000000000ULL, 0x0000000000000000ULL }, // 5^2
+    { 0xfa00000000000000ULL, 0x0000000000000000ULL }, // 5^3
+    { 0x9c40000000000000ULL, 0x0000000000000000ULL }, // 5^4
+    { 0xc350000000000000ULL, 0x0000000000000000ULL }, // 5^5
+    { 0xf424000000000000ULL, 0x0000000000000000ULL }, // 5^6
+    { 0x9896800000000000ULL, 0x0000000000000000ULL }, // 5^7
+    { 0xbebc200000000000ULL, 0x0000000000000000ULL }, // 5^8
+    { 0xee6b280000000000ULL, 0x0000000000000000ULL }, // 5^9
+    { 0x9502f90000000000ULL, 0x0000000000000000ULL }, // 5^10
+    { 0xba43b74000000000ULL, 0x0000000000000000ULL }, // 5^11
+    { 0xe8d4a51000000000ULL, 0x0000000000000000ULL }, // 5^12
+    { 0x9184e72a00000000ULL, 0x0000000000000000ULL }, // 5^13
+    { 0xb5e620f480000000ULL, 0x0000000000000000ULL }, // 5^14
+    { 0xe35fa931a0000000ULL, 0x0000000000000000ULL }, // 5^15
+    { 0x8e1bc9bf04000000ULL, 0x0000000000000000ULL }, // 5^16
+    { 0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL }, // 5^17
+    { 0xde0b6b3a76400000ULL, 0x0000000000000000ULL }, // 5^18
+    { 0x8ac7230489e80000ULL, 0x0000000000000000ULL }, // 5^19
+    { 0xad78ebc5ac620000ULL, 0x0000000000000000ULL }, // 5^20
+    { 0xd8d726b7177a8000ULL, 0x0000000000000000ULL }, // 5^21
+    { 0x878678326eac9000ULL, 0x0000000000000000ULL }, // 5^22
+    { 0xa968163f0a57b400ULL, 0x0000000000000000ULL }, // 5^23
+    { 0xd3c21bcecceda100ULL, 0x0000000000000000ULL }, // 5^24
+    { 0x84595161401484a0ULL, 0x0000000000000000ULL }, // 5^25
+    { 0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL }, // 5^26
+    { 0xcecb8f27f4200f3aULL, 0x0000000000000000ULL }, // 5^27
+    { 0x813f3978f8940984ULL, 0x4000000000000000ULL }, // 5^28
+    { 0xa18f07d736b90be5ULL, 0x5000000000000000ULL }, // 5^29
+    { 0xc9f2c9cd04674edeULL, 0xa400000000000000ULL }, // 5^30
+    { 0xfc6f7c4045812296ULL, 0x4d00000000000000ULL }, // 5^31
+    { 0x9dc5ada82b70b59dULL, 0xf020000000000000ULL }, // 5^32
+    { 0xc5371912364ce305ULL, 0x6c28000000000000ULL }, // 5^33
+    { 0xf684df56c3e01bc6ULL, 0xc732000000000000ULL }, // 5^34
+    { 0x9a130b963a6c115cULL, 0x3c7f400000000000ULL }, // 5^35
+    { 0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL }, // 5^36
+    { 0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL }, // 5^37
+    { 0x96769950b50d88f4ULL, 0x1314448000000000ULL }, // 5^38
+    { 0xbc143fa4e250eb31ULL, 0x17d955a000000000ULL }, // 5^39
+    { 0xeb194f8e1ae525fdULL, 0x5dcfab0800000000ULL }, // 5^40
+    { 0x92efd1b8d0cf37beULL, 0x5aa1cae500000000ULL }, // 5^41
+    { 0xb7abc627050305adULL, 0xf14a3d9e40000000ULL }, // 5^42
+    { 0xe596b7b0c643c719ULL, 0x6d9ccd05d0000000ULL }, // 5^43
+    { 0x8f7e32ce7bea5c6fULL, 0xe4820023a2000000ULL }, // 5^44
+    { 0xb35dbf821ae4f38bULL, 0xdda2802c8a800000ULL }, // 5^45
+    { 0xe0352f62a19e306eULL, 0xd50b2037ad200000ULL }, // 5^46
+    { 0x8c213d9da502de45ULL, 0x4526f422cc340000ULL }, // 5^47
+    { 0xaf298d050e4395d6ULL, 0x9670b12b7f410000ULL }, // 5^48
+    { 0xdaf3f04651d47b4cULL, 0x3c0cdd765f114000ULL }, // 5^49
+    { 0x88d8762bf324cd0fULL, 0xa5880a69fb6ac800ULL }, // 5^50
+    { 0xab0e93b6efee0053ULL, 0x8eea0d047a457a00ULL }, // 5^51
+    { 0xd5d238a4abe98068ULL, 0x72a4904598d6d880ULL }, // 5^52
+    { 0x85a36366eb71f041ULL, 0x47a6da2b7f864750ULL }, // 5^53
+    { 0xa70c3c40a64e6c51ULL, 0x999090b65f67d924ULL }, // 5^54
+    { 0xd0cf4b50cfe20765ULL, 0xfff4b4e3f741cf6dULL }, // 5^55
+    { 0x82818f1281ed449fULL, 0xbff8f10e7a8921a4ULL }, // 5^56
+    { 0xa321f2d7226895c7ULL, 0xaff72d52192b6a0dULL }, // 5^57
+    { 0xcbea6f8ceb02bb39ULL, 0x9bf4f8a69f764490ULL }, // 5^58
+    { 0xfee50b7025c36a08ULL, 0x02f236d04753d5b4ULL }, // 5^59
+    { 0x9f4f2726179a2245ULL, 0x01d762422c946590ULL }, // 5^60
+    { 0xc722f0ef9d80aad6ULL, 0x424d3ad2b7b97ef5ULL }, // 5^61
+    { 0xf8ebad2b84e0d58bULL, 0xd2e0898765a7deb2ULL }, // 5^62
+    { 0x9b934c3b330c8577ULL, 0x63cc55f49f88eb2fULL }, // 5^63
+    { 0xc2781f49ffcfa6d5ULL, 0x3cbf6b71c76b25fbULL }, // 5^64
+};
+
+static const double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * Eisel-Lemire: correctly rounds w * 10^q to the nearest double using one
+ * (rarely two) 64x64->128 bit multiplications against a truncated 5^q.
+ * @return boolean: False when the result cannot be decided here (exponent
+ * out of the table, subnormal or overflow), the caller then falls back.
+ */
+static boolean eisel_lemire(u64 w, s64 q, boolean negative, double *out)
+{
+    if (w == 0)
+    {
+        *out = negative ? -0.0 : 0.0;
+        return TRUE;
+    }
+    if (q < CSV_POW5_MIN || q > CSV_POW5_MAX)
+    {
+        return FALSE;
+    }
+
+    s32 lz = __builtin_clzll(w);
+    w <<= lz;
+    const u64 *pow5 = power_of_five_128[q - CSV_POW5_MIN];
+
+    u128 first = (u128)w * pow5[0];
+    u64 high = (u64)(first >> 64);
+    u64 low = (u64)first;
+    if ((high & 0x1FF) == 0x1FF)
+    {
+        u64 second_high = (u64)(((u128)w * pow5[1]) >> 64);
+        low += second_high;
+        high += second_high > low;
+    }
+    if (low == 0xFFFFFFFFFFFFFFFFULL && (q < -27 || q > 55))
+    {
+        return FALSE;
+    }
+
+    s32 upperbit = (s32)(high >> 63);
+    s32 shift = upperbit + 9;
+    u64 mantissa = high >> shift;
+    s32 power2 = (s32)((((152170 + 65536) * q) >> 16) + 63) + upperbit - lz + 1023;
+    if (power2 <= 0)
+    {
+        return FALSE;
+    }
+
+    // Exactly halfway between two doubles: round to even instead of up
+    if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << shift) == high)
+    {
+        mantissa &= ~1ULL;
+    }
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (2ULL << 52))
+    {
+        mantissa = 1ULL << 52;
+        power2++;
+    }
+    mantissa &= ~(1ULL << 52);
+    if (power2 >= 0x7FF)
+    {
+        return FALSE;
+    }
+
+    u64 bits = mantissa | ((u64)power2 << 52) | ((u64)negative << 63);
+    memcpy(out, &bits, sizeof(bits));
+    return TRUE;
+}
+
+// Slow path for what the kernels do not decide, copies the cell to NUL terminate it
+static double fallback_strtod(String_View cell)
 {
-    if (!column)
+    s8 buffer[64];
+    s8 *text = cell.size < sizeof(buffer) ? buffer : malloc(cell.size + 1);
+    if (!text)
     {
-        set_error(ERR_INVALID_ARG);
-        return;
+        set_error(ERR_MEM_ALLOC);
+        return -1.0;
     }
-
-    for (u64 row = 0; row < rows; row++)
+    memcpy(text, cell.data, cell.size);
+    text[cell.size] = '\0';
+    double value = strtod(text, NULL);
+    if (text != buffer)
     {
-        printf(sv_fmt"\n", sv_args(column[row]));
+        free(text);
     }
+    return value;
 }
 
-void fillna(CSV *csv)
+// End Number Parsing
+
+s64 to_integer(String_View cell)
 {
-    if (!csv || is_csv_empty(csv))
+    if (cell.size == 0 || cell.data == NULL)
     {
-        set_error(ERR_CSV_EMPTY);
-        return;
+        set_error(ERR_EMPTY_CELL);
+        return -1;
     }
 
-    for (s64 row = 0; row < csv->rows_count - 1; row++)
+    const u8 *p = cell.data;
+    const u8 *end = cell.data + cell.size;
+    boolean negative = *p == '-';
+    if (*p == '-' || *p == '+')
     {
-        for (s64 col = 0; col < csv->cols_count; col++)
-        {
-            if (csv->rows[row].cells[col].size == 0 || csv->rows[row].cells[col].data == NULL)
-            {
-                if (csv->type[col] == CSV_TYPE_FLOAT || csv->type[col] ==  CSV_TYPE_INTEGER)
-                {
-                    csv->rows[row].cells[col].data = "NaN";
-                    csv->rows[row].cells[col].size = 3;
-                } 
-                else 
-                {
-                    csv->rows[row].cells[col].data = "None";
-                    csv->rows[row].cells[col].size = 4;
-                }
-            }
-        }
+        p++;
     }
-}
 
-CSV dropna(CSV *input_csv)
-{   
-    if (!input_csv || is_csv_empty(input_csv))
+    while (p < end && *p == '0')
     {
-        set_error(ERR_CSV_EMPTY);
-        return (CSV){0};
+        p++;
     }
 
-    u64 valid_rows = 0;
-    for (u64 row = 0; row < get_row_count(input_csv) - 1; row++)
+    u64 value = 0;
+    if (accumulate_digits(&p, end, &value) > 19 || value > (u64)INT64_MAX + negative)
     {
-        boolean empty = FALSE;
-        for (u64 col = 0; col < get_col_count(input_csv); col++)
-        {
-            if (is_cell_empty(input_csv->rows[row].cells[col]))
-            {
-                empty = TRUE;
-                break;
-            }
-        }
-
-        if (!empty)
-        {
-            valid_rows++;
-        }
+        // Saturates like strtoll
+        return negative ? INT64_MIN : INT64_MAX;
     }
-    
-    if (valid_rows == get_row_count(input_csv) - 1)
+    return negative ? (s64)(0 - value) : (s64)value;
+}
+
+double to_float(String_View cell)
+{
+    if (cell.size == 0 || cell.data == NULL)
     {
-        return (CSV){0};
+        set_error(ERR_EMPTY_CELL);
+        return -1.0;
     }
 
-    CSV output_csv;
-    init_csv(&output_csv);
-    output_csv.cols_count = input_csv->cols_count;
-    output_csv.rows_count = valid_rows;
-    output_csv.type = input_csv->type;
-    output_csv.header = arena_alloc(&output_csv.allocator, input_csv->cols_count * sizeof(String_View));
-    if (!output_csv.header)
+    const u8 *p = cell.data;
+    const u8 *end = cell.data + cell.size;
+    boolean negative = *p == '-';
+    if (*p == '-' || *p == '+')
     {
-        set_error(ERR_MEM_ALLOC);
-        return (CSV){0};
+        p++;
     }
-    memcpy(output_csv.header, input_csv->header, input_csv->cols_count * sizeof(String_View));
-    output_csv.rows = arena_alloc(&output_csv.allocator, valid_rows * sizeof(Row));
-    if (!output_csv.rows)
+
+    const u8 *number = p;
+    while (p < end && *p == '0')
     {
-        set_error(ERR_MEM_ALLOC);
-        return (CSV){0};
+        p++;
     }
 
-    u64 new_row = 0;
-    for (u64 row = 0; row < get_row_count(input_csv) - 1; row++)
+    u64 w = 0;
+    u64 digits = accumulate_digits(&p, end, &w);
+    s64 exponent = 0;
+    boolean has_digits = p > number;
+    if (p < end && *p == '.')
     {
-        boolean empty = FALSE;
-        for (u64 col = 0; col < get_col_count(input_csv); col++)
+        p++;
+        const u8 *fraction = p;
+        if (digits == 0)
         {
-            if (is_cell_empty(input_csv->rows[row].cells[col]))
+            // Leading zeros of the fraction only move the exponent
+            while (p < end && *p == '0')
             {
-                empty = TRUE;
-                break;
+                p++;
             }
         }
+        u64 fraction_digits = accumulate_digits(&p, end, &w);
+        digits += fraction_digits;
+        exponent -= p - fraction;
+        has_digits |= p > fraction;
+    }
 
-        if (!empty)
+    if (!has_digits || digits > 19)
+    {
+        return fallback_strtod(cell);
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const u8 *e = p + 1;
+        boolean negative_exponent = e < end && *e == '-';
+        if (e < end && (*e == '-' || *e == '+'))
         {
-            output_csv.rows[new_row++] = input_csv->rows[row];
+            e++;
+        }
+        s64 exp_value = 0;
+        const u8 *exp_digits = e;
+        while (e < end && (u8)(*e - '0') < 10 && exp_value < 100000)
+        {
+            exp_value = exp_value * 10 + (*e - '0');
+            e++;
+        }
+        if (e > exp_digits)
+        {
+            exponent += negative_exponent ? -exp_value : exp_value;
+            p = e;
         }
     }
-    output_csv.rows_count++; // for header
-    return output_csv;
-}
 
-s64 to_integer(String_View cell)
-{
-    if (cell.size == 0 || cell.data == NULL)
+    // Clinger's fast path: both operands are exact doubles, one rounding
+    if (w <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
     {
-        set_error(ERR_EMPTY_CELL);
-        return -1;
+        double value = (double)w;
+        value = exponent < 0 ? value / exact_powers_of_ten[-exponent] : value * exact_powers_of_ten[exponent];
+        return negative ? -value : value;
     }
-    s8 buffer[21];
-    s8 *endptr;
-    memcpy(buffer, cell.data, cell.size);
-    buffer[cell.size] = '\0';
-    return strtoll(buffer, &endptr, 10);
-}
 
-double to_float(String_View cell)
-{
-    if (cell.size == 0 || cell.data == NULL)
+    double value;
+    if (eisel_lemire(w, exponent, negative, &value))
     {
-        set_error(ERR_EMPTY_CELL);
-        return -1.0;
+        return value;
     }
-    s8 buffer[21];
-    s8 *endptr;
-    memcpy(buffer, cell.data, cell.size);
-    buffer[cell.size] = '\0';
-    return strtold(buffer, &endptr);
+    return fallback_strtod(cell);
 }
 
 boolean is_csv_empty(CSV *csv)
@@ -810,25 +5634,26 @@ void convert_cell_to_integer(CSV *csv, u32 row, u32 col, s64 *output)
         return;
     }
 
-    if (csv->type[col] != CSV_TYPE_INTEGER)
+    // Materialized first, as sampled types can be promoted on the way
+    const Typed_Column *typed = typed_column_at(csv, col);
+    if (!typed)
+    {
+        return;
+    }
+
+    if (typed->type != CSV_TYPE_INTEGER)
     {
         set_error(ERR_CSV_DIFF_TYPE);
         return;
     }
 
-    String_View cell = csv->rows[row - 1].cells[col];
-    if (cell.size == 0)
+    if (!typed->valid[row - 1])
     {
         set_error(ERR_EMPTY_CELL);
         return;
     }
 
-    s8 buffer[21];
-    memcpy(buffer, cell.data, cell.size);
-    buffer[cell.size] = '\0';
-
-    s8 *endptr;
-    *output = strtoll(buffer, &endptr, 10);
+    *output = typed->integers[row - 1];
     return;
 }
 
@@ -846,25 +5671,26 @@ void convert_cell_to_float(CSV *csv, u32 row, u32 col, double *output)
         return;
     }
 
-    if (csv->type[col] != CSV_TYPE_FLOAT)
+    // Materialized first, as sampled types can be promoted on the way
+    const Typed_Column *typed = typed_column_at(csv, col);
+    if (!typed)
+    {
+        return;
+    }
+
+    if (typed->type != CSV_TYPE_FLOAT)
     {
         set_error(ERR_CSV_DIFF_TYPE);
         return;
     }
 
-    String_View cell = csv->rows[row - 1].cells[col];
-    if (cell.size == 0)
+    if (!typed->valid[row - 1])
     {
         set_error(ERR_EMPTY_CELL);
         return;
     }
 
-    s8 buffer[21];
-    memcpy(buffer, cell.data, cell.size);
-    buffer[cell.size] = '\0';
-
-    s8 *endptr;
-    *output = strtold(buffer, &endptr);
+    *output = typed->floats[row - 1];
     return;
 }
 
@@ -896,7 +5722,7 @@ String_View get_cell(CSV *csv, u32 row, String_View *column_name)
         set_error(ERR_INVALID_COLUMN);
         return sv_null;
     }
-    return csv->rows[row - 1].cells[col];
+    return *cell_at(csv, row - 1, col);
 }
 
 const String_View *get_row_at(CSV *csv, u32 idx)
@@ -906,7 +5732,24 @@ const String_View *get_row_at(CSV *csv, u32 idx)
         set_error(ERR_INVALID_COLUMN);
         return NULL;
     }
-    return csv->rows[idx].cells;
+
+    if (csv->layout == CSV_LAYOUT_ROWS)
+    {
+        return row_cells(csv, idx);
+    }
+
+    String_View *ret = arena_alloc(&csv->scratch, sizeof(String_View) * get_col_count(csv));
+    if (!ret)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return NULL;
+    }
+
+    for (u64 col = 0; col < get_col_count(csv); col++)
+    {
+        ret[col] = *cell_at(csv, idx, col);
+    }
+    return ret;
 }
 
 const String_View *get_column(CSV *csv, String_View column_name)
@@ -924,7 +5767,12 @@ const String_View *get_column(CSV *csv, String_View column_name)
         return NULL;
     }
 
-    String_View *ret = arena_alloc(&csv->allocator, sizeof(String_View) * get_row_count(csv));
+    if (csv->layout == CSV_LAYOUT_COLUMNS)
+    {
+        return csv->columns[column_index];
+    }
+
+    String_View *ret = arena_alloc(&csv->scratch, sizeof(String_View) * get_row_count(csv));
     if (!ret)
     {
         set_error(ERR_MEM_ALLOC);
@@ -934,7 +5782,7 @@ const String_View *get_column(CSV *csv, String_View column_name)
     ret[0] = csv->header[column_index];
     for (u64 row = 0; row < get_row_count(csv) - 1; row++)
     {
-        ret[row + 1] = csv->rows[row].cells[column_index];
+        ret[row + 1] = *cell_at(csv, row, column_index);
     }
     return ret;
 }
@@ -952,6 +5800,9 @@ void append_column(CSV *csv, String_View *column_to_append, u32 rows)
         set_error(ERR_CSV_OUT_OF_BOUNDS);
         return;
     }
+    invalidate_typed_columns(csv);
+    csv->source_offset = 0; // the table no longer mirrors the file
+    csv->tail_rows = 0;
     u32 new_col_index = csv->cols_count;
     csv->cols_count++;
     csv->header = arena_realloc(
@@ -966,20 +5817,74 @@ void append_column(CSV *csv, String_View *column_to_append, u32 rows)
         return;
     }
     csv->header[new_col_index] = column_to_append[0];
+    insert_into_hash(csv, &csv->header[new_col_index], new_col_index);
+
+    csv->type = arena_realloc(
+                                &csv->allocator,
+                                csv->type,
+                                (csv->cols_count - 1) * sizeof(ColumnType),
+                                csv->cols_count * sizeof(ColumnType)
+                             );
+    if (!csv->type)
+    {
+        set_error(ERR_MEM_ALLOC);
+        return;
+    }
 
-    for (u32 row = 0; row < rows - 1; row++)
+    if (csv->layout == CSV_LAYOUT_COLUMNS)
+    {
+        csv->columns = arena_realloc(
+                                        &csv->allocator,
+                                        csv->columns,
+                                        (csv->cols_count - 1) * sizeof(String_View *),
+                                        csv->cols_count * sizeof(String_View *)
+                                    );
+        if (!csv->columns)
+        {
+            set_error(ERR_MEM_ALLOC);
+            return;
+        }
+
+        // Same room as the other columns, so append_row can keep filling them
+        u64 capacity = csv->rows_capacity > rows - 1 ? csv->rows_capacity : rows - 1;
+        csv->columns[new_col_index] = arena_alloc(&csv->allocator, (capacity + 1) * sizeof(String_View));
+        if (!csv->columns[new_col_index])
+        {
+            set_error(ERR_MEM_ALLOC);
+            return;
+        }
+        memcpy(csv->columns[new_col_index], column_to_append, rows * sizeof(String_View));
+        detect_column_type(csv, new_col_index);
+        return;
+    }
+
+    if (csv->cols_count > csv->cols_capacity)
     {
-        csv->rows[row].cells = arena_realloc(
-                                                &csv->allocator, 
-                                                csv->rows[row].cells, 
-                                                (csv->cols_count - 1) * sizeof(String_View), 
-                                                csv->cols_count * sizeof(String_View)
-                                            );
-        if (!csv->rows[row].cells)
+        // Move every row to one slab with room for twice the columns, so
+        // appending more columns does not copy the rows again
+        u64 old_cols = csv->cols_count - 1;
+        u64 cols_capacity = old_cols * 2 > csv->cols_count ? old_cols * 2 : csv->cols_count;
+        String_View *slab = arena_alloc(&csv->allocator, (u64)(rows - 1) * cols_capacity * sizeof(String_View));
+        if (!slab)
         {
             set_error(ERR_MEM_ALLOC);
             return;
         }
+        for (u32 row = 0; row < rows - 1; row++)
+        {
+            String_View *cells = row_cells(csv, row);
+            if (!cells)
+            {
+                return;
+            }
+            memcpy(slab + row * cols_capacity, cells, old_cols * sizeof(String_View));
+            csv->rows[row].cells = slab + row * cols_capacity;
+        }
+        csv->cols_capacity = cols_capacity;
+    }
+
+    for (u32 row = 0; row < rows - 1; row++)
+    {
         csv->rows[row].cells[new_col_index] = column_to_append[row + 1];
     }
     detect_column_type(csv, new_col_index);
@@ -1021,19 +5926,65 @@ void append_row(CSV *csv, String_View *row_to_append, u32 cols_to_append)
         return;
     }
 
-    // This is mess hahaha
-    u64 rows, new_rows;
-    rows = csv->rows_count - 1;
-    new_rows = rows + 1;
-    u64 new_row_index = rows;
-    csv->rows_count++;
-    csv->rows = (Row *)arena_realloc(&csv->allocator, csv->rows, sizeof(Row *) * (rows), sizeof(Row *) * (new_rows - 1));
-    if (!csv->rows)
+    invalidate_typed_columns(csv);
+    csv->source_offset = 0; // the table no longer mirrors the file
+    csv->tail_rows = 0;
+
+    // Tables grow geometrically, loaders that do not record their capacity left it exact
+    u64 rows = csv->rows_count - 1;
+    if (rows >= csv->rows_capacity)
+    {
+        u64 capacity = rows * 2 > ROWS_INITIAL_CAPACITY ? rows * 2 : ROWS_INITIAL_CAPACITY;
+        if (csv->layout == CSV_LAYOUT_COLUMNS)
+        {
+            for (u64 col = 0; col < csv->cols_count; col++)
+            {
+                csv->columns[col] = arena_realloc(
+                                                    &csv->allocator,
+                                                    csv->columns[col],
+                                                    (rows + 1) * sizeof(String_View),
+                                                    (capacity + 1) * sizeof(String_View)
+                                                 );
+                if (!csv->columns[col])
+                {
+                    set_error(ERR_MEM_ALLOC);
+                    return;
+                }
+            }
+        }
+        else
+        {
+            csv->rows = (Row *)arena_realloc(&csv->allocator, csv->rows, rows * sizeof(Row), capacity * sizeof(Row));
+            if (!csv->rows)
+            {
+                set_error(ERR_MEM_ALLOC);
+                return;
+            }
+        }
+        csv->rows_capacity = capacity;
+    }
+
+    if (csv->layout == CSV_LAYOUT_COLUMNS)
+    {
+        for (u64 col = 0; col < csv->cols_count; col++)
+        {
+            csv->columns[col][rows + 1] = row_to_append[col];
+        }
+        csv->rows_count++;
+        return;
+    }
+
+    // Copied with the same room as the other rows, for append_column
+    u64 cols_capacity = csv->cols_capacity > csv->cols_count ? csv->cols_capacity : csv->cols_count;
+    String_View *cells = arena_alloc(&csv->allocator, cols_capacity * sizeof(String_View));
+    if (!cells)
     {
         set_error(ERR_MEM_ALLOC);
         return;
     }
-    csv->rows[new_row_index].cells = row_to_append;
+    memcpy(cells, row_to_append, csv->cols_count * sizeof(String_View));
+    csv->rows[rows].cells = cells;
+    csv->rows_count++;
     // Needs check if each cell from new row matches the column type
     return;
 }
@@ -1078,7 +6029,7 @@ String_View *csv_filter(CSV *csv, String_View column_name, boolean (*predicate)(
     *out_count = 0;
     for (u32 row = 0; row < csv->rows_count - 1; row++)
     {
-        if (predicate(csv->rows[row].cells[col]))
+        if (predicate(*cell_at(csv, row, col)))
         {
             (*out_count)++;
         }
@@ -1089,7 +6040,7 @@ String_View *csv_filter(CSV *csv, String_View column_name, boolean (*predicate)(
         return NULL;
     }
 
-    String_View *filtered_cells = arena_alloc(&csv->allocator, sizeof(String_View) * (*out_count));
+    String_View *filtered_cells = arena_alloc(&csv->scratch, sizeof(String_View) * (*out_count));
     if (!filtered_cells)
     {
         set_error(ERR_MEM_ALLOC);
@@ -1099,14 +6050,94 @@ String_View *csv_filter(CSV *csv, String_View column_name, boolean (*predicate)(
     u32 index = 0;
     for (u32 row = 0; row < csv->rows_count - 1; row++)
     {
-        if (predicate(csv->rows[row].cells[col]))
+        if (predicate(*cell_at(csv, row, col)))
         {
-            filtered_cells[index++] = csv->rows[row].cells[col];
+            filtered_cells[index++] = *cell_at(csv, row, col);
         }
     }
     return filtered_cells;
 }
 
+static void add_arena_stats(const Arena *a, CSV_Memory_Stats *stats)
+{
+    for (u32 list = 0; list < 2; list++)
+    {
+        for (const Region *r = list ? a->large : a->begin; r != NULL; r = r->next)
+        {
+            stats->used += r->size;
+            stats->reserved += r->capacity;
+            stats->regions++;
+        }
+    }
+    stats->requested += a->requested;
+    stats->peak += a->peak;
+}
+
+static inline boolean in_mapping(const CSV *csv, const void *p)
+{
+    return csv->mapping && (const u8 *)p >= csv->mapping && (const u8 *)p < csv->mapping + csv->mapping_size;
+}
+
+void csv_memory_stats(const CSV *csv, CSV_Memory_Stats *stats)
+{
+    if (!csv || !stats)
+    {
+        set_error(ERR_INVALID_ARG);
+        return;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    add_arena_stats(&csv->allocator, stats);
+    add_arena_stats(&csv->scratch, stats);
+    stats->query_temporaries = csv->scratch.requested;
+    stats->raw_buffer = csv->text_size + csv->mapping_size;
+    stats->hash_entries = csv->hash_entries * sizeof(HashEntry);
+
+    u64 rows = csv->rows_count ? csv->rows_count - 1 : 0;
+    u64 capacity = csv->rows_capacity > rows ? csv->rows_capacity : rows;
+    if (csv->header && !in_mapping(csv, csv->header))
+    {
+        stats->cells += csv->cols_count * sizeof(String_View);
+    }
+    if (csv->layout == CSV_LAYOUT_COLUMNS && csv->columns && !in_mapping(csv, csv->columns))
+    {
+        stats->row_tables += csv->cols_count * sizeof(String_View *);
+        stats->cells += csv->cols_count * (capacity + 1) * sizeof(String_View);
+    }
+    else if (csv->layout == CSV_LAYOUT_ROWS && csv->rows && !in_mapping(csv, csv->rows))
+    {
+        stats->row_tables += capacity * sizeof(Row);
+        u64 cols = csv->cols_capacity > csv->cols_count ? csv->cols_capacity : csv->cols_count;
+        if (csv->row_starts)
+        {
+            // Lazy: only the rows split so far have cells
+            stats->row_tables += (rows + 1) * sizeof(u8 *);
+            for (u64 row = 0; row < rows; row++)
+            {
+                stats->cells += csv->rows[row].cells ? cols * sizeof(String_View) : 0;
+            }
+        }
+        else
+        {
+            stats->cells += rows * cols * sizeof(String_View);
+        }
+    }
+
+    if (csv->typed && !in_mapping(csv, csv->typed))
+    {
+        stats->typed_columns += csv->cols_count * sizeof(Typed_Column);
+        for (u64 col = 0; col < csv->cols_count; col++)
+        {
+            const Typed_Column *typed = &csv->typed[col];
+            if (typed->valid)
+            {
+                size_t value_size = typed->type == CSV_TYPE_BOOLEAN ? sizeof(boolean) : sizeof(s64);
+                stats->typed_columns += typed->capacity * (sizeof(boolean) + value_size);
+            }
+        }
+    }
+}
+
 
 void csv_mean(CSV *csv, String_View column_name, double *output)
 {
@@ -1123,24 +6154,30 @@ void csv_mean(CSV *csv, String_View column_name, double *output)
         return;
     }
 
-    if (csv->type[col] != CSV_TYPE_INTEGER && csv->type[col] != CSV_TYPE_FLOAT)
+    if (get_row_count(csv) == 0)
     {
-        set_error(ERR_CSV_DIFF_TYPE);
+        set_error(ERR_CSV_EMPTY);
         return;
     }
 
-    if (get_row_count(csv) == 0)
+    const Typed_Column *typed = typed_column_at(csv, col);
+    if (!typed)
     {
-        set_error(ERR_CSV_EMPTY);
+        return;
+    }
+
+    if (typed->type != CSV_TYPE_INTEGER && typed->type != CSV_TYPE_FLOAT)
+    {
+        set_error(ERR_CSV_DIFF_TYPE);
         return;
     }
 
     double sum = 0.0;
-    for (s64 row = 0; row < get_row_count(csv) - 1; row++)
+    for (u64 row = 0; row < typed->count; row++)
     {
-        if (!is_cell_empty(csv->rows[row].cells[col]))
+        if (typed->valid[row])
         {
-            sum += to_float(csv->rows[row].cells[col]);
+            sum += typed_value(typed, row);
         }
     }
 
@@ -1169,16 +6206,22 @@ void csv_median(CSV *csv, String_View column_name, double *output)
         return;
     }
 
-    if ((csv->type[col] != CSV_TYPE_INTEGER && csv->type[col] != CSV_TYPE_FLOAT))
+    u64 row_count = get_row_count(csv) - 1;
+    if (row_count == 0)
     {
-        set_error(ERR_CSV_DIFF_TYPE);
+        set_error(ERR_CSV_EMPTY);
         return;
     }
 
-    u64 row_count = get_row_count(csv) - 1;
-    if (row_count == 0)
+    const Typed_Column *typed = typed_column_at(csv, col);
+    if (!typed)
     {
-        set_error(ERR_CSV_EMPTY);
+        return;
+    }
+
+    if (typed->type != CSV_TYPE_INTEGER && typed->type != CSV_TYPE_FLOAT)
+    {
+        set_error(ERR_CSV_DIFF_TYPE);
         return;
     }
 
@@ -1192,15 +6235,16 @@ void csv_median(CSV *csv, String_View column_name, double *output)
     u64 valid_count = 0;
     for (u64 row = 0; row < row_count; row++)
     {
-        if (!is_cell_empty(csv->rows[row].cells[col]))
+        if (typed->valid[row])
         {
-            values[valid_count++] = to_float(csv->rows[row].cells[col]);
+            values[valid_count++] = typed_value(typed, row);
         }
     }
 
     if (valid_count == 0)
     {
         *output = 0.0;
+        free(values);
         return;
     }
 
@@ -1232,16 +6276,22 @@ void csv_sd(CSV *csv, String_View column_name, double *output)
         return;
     }
 
-    if ((csv->type[col] != CSV_TYPE_INTEGER && csv->type[col] != CSV_TYPE_FLOAT))
+    u64 row_count = get_row_count(csv) - 1;
+    if (row_count == 0)
     {
-        set_error(ERR_CSV_DIFF_TYPE);
+        set_error(ERR_CSV_EMPTY);
         return;
     }
 
-    u64 row_count = get_row_count(csv) - 1;
-    if (row_count == 0)
+    const Typed_Column *typed = typed_column_at(csv, col);
+    if (!typed)
     {
-        set_error(ERR_CSV_EMPTY);
+        return;
+    }
+
+    if (typed->type != CSV_TYPE_INTEGER && typed->type != CSV_TYPE_FLOAT)
+    {
+        set_error(ERR_CSV_DIFF_TYPE);
         return;
     }
 
@@ -1250,9 +6300,9 @@ void csv_sd(CSV *csv, String_View column_name, double *output)
 
     for (u64 row = 0; row < row_count; row++)
     {
-        if (!is_cell_empty(csv->rows[row].cells[col]))
+        if (typed->valid[row])
         {
-            double value = to_float(csv->rows[row].cells[col]);
+            double value = typed_value(typed, row);
             sum += value;
             sum_sq += value * value;
             valid_count++;
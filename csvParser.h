@@ -25,7 +25,9 @@ typedef u8 boolean;
 #define TRUE 1
 #define FALSE 0
 
-#define REGION_DEFAULT_CAPACITY (8 * 1024)
+#define REGION_DEFAULT_CAPACITY (64 * 1024)       // bytes of the first region
+#define REGION_MAX_CAPACITY (64 * 1024 * 1024)    // regions double up to this size
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)          // smallest region ARENA_HUGE_PAGES maps
 #define BUCKETS 8
 
 #define sv_null (String_View){ .data = NULL, .size = 0 }
@@ -34,6 +36,22 @@ typedef u8 boolean;
 #define sv_fmt "%.*s"
 
 #define BUFFER_SIZE 8192
+#define SCAN_BLOCK_SIZE 64
+#define HEADER_INITIAL_CAPACITY 16
+#define ROWS_INITIAL_CAPACITY 1024
+#define SLAB_MIN_ROWS 64
+#define LAZY_TYPE_ROWS 1024
+#define PARALLEL_MIN_CHUNK_SIZE (1024 * 1024)
+#define SNIFF_SIZE (4 * 1024)
+#define READER_CHUNK_SIZE (1024 * 1024)
+#define PIPELINE_BUFFERS 2
+#define DECODE_INPUT_SIZE (256 * 1024)
+#define CACHE_MAGIC 0x3148434143565343ULL // "CSVCACH1"
+#define CACHE_VERSION 2
+#define CACHE_HASH_SAMPLE (64 * 1024)
+#define ROW_INDEX_MAGIC 0x3158444957525343ULL // "CSRWIDX1"
+#define ROW_INDEX_STRIDE 1024
+#define ROW_INDEX_SUFFIX ".idx"
 
 #define ALIGNMENT 16  
 #define ALIGN_UP(x, a) (((x) + (a - 1)) & ~(a - 1))
@@ -54,6 +72,12 @@ typedef enum {
     ERR_INVALID_COLUMN,
     ERR_INVALID_ARG,
     ERR_INCONSISTENT_COLUMNS,
+    ERR_MAP_FILE,
+    ERR_READ_FILE,
+    ERR_WRITE_FILE,
+    ERR_CACHE_STALE,
+    ERR_COMPRESSION,
+    ERR_SOURCE_CHANGED,
     ERR_UNKNOWN
 } ERRNO;
 
@@ -66,18 +90,40 @@ typedef enum {
 } ColumnType;
 
 
+// Where arena regions come from, flags set in Arena.backing before its first allocation
+typedef enum {
+    ARENA_MALLOC = 0,
+    ARENA_HUGE_PAGES = 1, // regions of HUGE_PAGE_SIZE and up are mmapped with MADV_HUGEPAGE
+    ARENA_NUMA_LOCAL = 2, // with ARENA_HUGE_PAGES, placed on the node of the thread creating them
+    ARENA_BACKING_FAILED = 4 // set by the arena when a region did not get the backing asked for
+} Arena_Backing;
+
 //----- Credits to tsoding: https://github.com/tsoding/arena ------
 typedef struct Region Region;
 typedef struct Region {
-    u32 size;
-    u32 capacity;
+    u64 size;     // bytes in use
+    u64 capacity; // bytes
     Region *next;
-    uintptr_t data[];
+    u64 mapped;   // bytes mmapped for it, 0 if it came from malloc
+    _Alignas(ALIGNMENT) u8 data[];
 } Region;
 
 typedef struct Arena {
-    Region *begin, *end;
+    Region *begin, *end; // regions after end are empty
+    u8 *last;            // most recent allocation, in end, NULL if it cannot grow in place
+    Region *large;       // allocations too big for a region of the list, newest first
+    u32 backing;         // Arena_Backing flags
+    u64 requested;       // bytes asked for by the allocations still held
+    u64 peak;            // most bytes requested at once
 } Arena;
+
+// Position of an arena, see arena_mark
+typedef struct Arena_Mark {
+    Region *region;
+    u64 size;
+    Region *large;
+    u64 requested;
+} Arena_Mark;
 // ----------------------------------------------------------------
 
 typedef struct String_View {
@@ -95,6 +141,79 @@ typedef struct HashTable {
     HashEntry *buckets[BUCKETS];
 } HashTable;
 
+/*
+ * How a file is laid out. A delimiter of 0 lets the loaders sniff it from
+ * the first SNIFF_SIZE bytes, a quote of 0 disables quoting.
+ */
+typedef struct CSV_Dialect {
+    u8 delimiter;
+    u8 quote;
+    boolean crlf;
+    boolean trim;
+} CSV_Dialect;
+
+/*
+ * How parsed cells are stored. CSV_LAYOUT_ROWS keeps one cell array per row,
+ * CSV_LAYOUT_COLUMNS keeps one contiguous array per column, with the header
+ * in slot 0, so column scans stay in contiguous memory and get_column does
+ * not copy.
+ */
+typedef enum {
+    CSV_LAYOUT_ROWS = 0,
+    CSV_LAYOUT_COLUMNS
+} CSV_Layout;
+
+/*
+ * Values of an integer, float or boolean column converted once from text.
+ * valid[row] is FALSE for empty cells, whose value is 0.
+ */
+typedef struct Typed_Column {
+    ColumnType type;
+    u64 count;
+    u64 capacity;
+    boolean *valid;
+    union {
+        void *values;
+        s64 *integers;
+        double *floats;
+        boolean *booleans;
+    };
+} Typed_Column;
+
+/*
+ * Limits type inference to the first head_rows rows plus one in one_in of
+ * the others, picked at random. A head_rows of 0 classifies every row.
+ * Sampled types are checked against the whole column, and promoted when a
+ * cell disagrees, the first time the column is used as numbers.
+ */
+typedef struct Type_Sampling {
+    u64 head_rows;
+    u32 one_in;
+} Type_Sampling;
+
+typedef enum {
+    FILTER_NONE = 0,
+    FILTER_PREDICATE,
+    FILTER_LT,
+    FILTER_LE,
+    FILTER_EQ,
+    FILTER_NE,
+    FILTER_GE,
+    FILTER_GT
+} Filter_Op;
+
+/*
+ * Keeps only the rows whose cell in column passes predicate, or compares to
+ * value as a number with op. Empty and non-numeric cells never pass a
+ * comparison. Rows are dropped while parsing, as soon as that cell is split.
+ */
+typedef struct Row_Filter {
+    Filter_Op op;
+    String_View column;
+    boolean (*predicate)(String_View cell); // FILTER_PREDICATE
+    double value;
+} Row_Filter;
+
 typedef struct Row {
     String_View *cells;
 } Row; 
@@ -105,18 +224,120 @@ typedef struct CSV {
     u64 rows_count;
     ColumnType *type;
     String_View *header;
-    Row *rows;
+    Row *rows;             // CSV_LAYOUT_ROWS
+    String_View **columns; // CSV_LAYOUT_COLUMNS
+    CSV_Layout layout;
+    Typed_Column *typed;       // one per column, filled on first numeric use
+    boolean materialize_types; // fill every typed column at load time
+    boolean lazy;              // split rows on first access, CSV_LAYOUT_ROWS only
+    u8 **row_starts;           // lazy: start of every data row, then the end
+    Row_Filter filter;         // rows the loaders keep, lazy is ignored when set
+    Type_Sampling sampling;
+    boolean types_sampled;
+    u8 *mapping;       // file mapping when loaded by read_csv_mmap or csv_load_cache
+    u64 mapping_size;
+    CSV_Dialect dialect;
+    Arena scratch;      // results of get_row_at, get_column and csv_filter
+    u64 rows_capacity;  // rows the row table, or every column array, can hold
+    u64 cols_capacity;  // CSV_LAYOUT_ROWS: cells every row can hold, cols_count if less
+    u8 *type_masks;     // per column, AND of the classified cells
+    u64 source_offset;  // csv_refresh: first byte left to parse, 0 if it cannot refresh
+    u64 tail_rows;      // csv_refresh: 1 if the last row had no newline and is parsed again
+    u64 text_size;      // bytes of file text the loaders copied to allocator
+    u64 hash_entries;   // index table entries allocated for it
 } CSV;
 
+/*
+ * Memory held by a CSV, see csv_memory_stats. The totals cover allocator and
+ * scratch. The categories are in bytes and estimate what each part takes.
+ */
+typedef struct CSV_Memory_Stats {
+    u64 requested;     // bytes asked for by live allocations
+    u64 used;          // bytes handed out, requested plus alignment
+    u64 reserved;      // bytes of every region, used plus their unused tails
+    u64 regions;
+    u64 peak;          // most bytes requested at once, summed over both arenas
+    u64 raw_buffer;    // file text in the arena, plus the whole file mapping
+    u64 row_tables;    // row table, column pointers or lazy row starts, at capacity
+    u64 cells;         // header and cell views, at capacity
+    u64 typed_columns;
+    u64 hash_entries;
+    u64 query_temporaries; // csv->scratch
+} CSV_Memory_Stats;
+
+// Decompressing file reader, defined in csvParser.c
+typedef struct Decode_Stream Decode_Stream;
+
+/*
+ * Streams a csv in batches of rows with bounded memory. csv holds the current
+ * batch: its header and types are shared by every batch, its rows live in
+ * csv.allocator, which is reset on every call.
+ */
+typedef struct CSV_Reader {
+    Decode_Stream *source;
+    CSV csv;
+    Arena header_arena; // header, types, carry and spare, which outlive every batch
+    u8 *carry;          // block of the file batches are parsed from
+    u64 carry_offset;   // first byte of it not parsed yet
+    u64 carry_size;
+    u64 carry_capacity;
+    u8 *spare;          // next carry, while rows of the batch point into the current one
+    u64 spare_capacity;
+    u8 *type_masks;
+    u64 batch_rows;
+    u64 batches;
+    boolean eof;
+} CSV_Reader;
+
+typedef void (*Row_Callback)(const CSV *csv, const String_View *row, void *user_data);
+
+/*
+ * Incremental parser for inputs that can only be read once, such as pipes.
+ * Bytes are pushed in any amount and every complete row is handed to on_row.
+ * csv holds the header and the dialect.
+ */
+typedef struct CSV_Parser {
+    CSV csv;
+    Arena header_arena;
+    Row_Callback on_row;
+    void *user_data;
+    u8 *pending;        // bytes of the record not complete yet
+    u64 pending_size;
+    u64 pending_capacity;
+    u64 scanned;        // pending bytes already searched for a newline
+    u64 quotes;         // quotes among them
+} CSV_Parser;
+
 /*  
  * ARENA ALLOCATOR IMPLEMENTATION
  */
 Region *new_region(size_t capacity);
 void free_region(Region *r);
 void *arena_alloc(Arena *a, size_t bytes);
+/*
+ * Makes room for the next bytes of allocations (after alignment) in a single
+ * region, so a caller that knows its total up front pays for one malloc.
+ * @return s32: 1 on success, 0 if out of memory.
+ */
+s32 arena_reserve(Arena *a, size_t bytes);
+/*
+ * Grows the most recent allocation in place while its region has room, and
+ * gives the space back when it shrinks. Any other block is copied to a new
+ * one when it grows.
+ */
 void *arena_realloc(Arena *a, void *_oldptr, size_t _oldsize, size_t _newsize);
 void arena_reset(Arena *a);
 void arena_free(Arena *a);
+/*
+ * Records the current position of an arena, to release everything allocated
+ * after it in one go with arena_rewind.
+ */
+Arena_Mark arena_mark(Arena *a);
+/*
+ * Releases every allocation made since mark was taken, keeping the regions
+ * for reuse. The arena must not have been reset since.
+ */
+void arena_rewind(Arena *a, Arena_Mark mark);
 
 /*  
  * ARENA ALLOCATOR IMPLEMENTATION
@@ -134,7 +355,9 @@ void arena_free(Arena *a);
 boolean error();
 
 /*
- * Initializes a CSV struct
+ * Initializes a CSV struct. Set csv->allocator.backing to Arena_Backing flags
+ * right after, before loading, to put its memory on huge pages; ARENA_BACKING_FAILED
+ * is set in it afterwards if some of that memory came from malloc instead.
  * @param csv: struct CSV
  */
 void init_csv(CSV *csv);
@@ -159,14 +382,182 @@ void print_csv(CSV *csv);
  */
 void print_column(const String_View *column, u64 rows);
 
+/*
+ * Guesses the dialect of a csv from its first SNIFF_SIZE bytes: the delimiter
+ * among ',', ';', '\t' and '|' that splits most lines like the header, and
+ * whether lines end with CRLF.
+ * @param buffer: Start of the file content.
+ * @param size: Size of the buffer.
+ * @return dialect: The guessed dialect, quoted with '"' and trimmed.
+ */
+CSV_Dialect sniff_dialect(const u8 *buffer, u64 size);
+
 /*
  * Reads a csv from a file, store its content in a CSV struct,
- * may throw an error.
+ * may throw an error. Every loader uses csv->dialect when it was set
+ * after init_csv and sniffs it otherwise, and stores the cells in
+ * csv->layout. With csv->lazy set, read_csv, read_csv_mmap and
+ * read_csv_parallel only record where rows start and split each row the
+ * first time it is accessed. With csv->filter set, every loader except the
+ * push parser drops the rows that do not pass it. Files compressed with gzip
+ * or zstd are detected from their first bytes and decompressed on a separate
+ * thread while they are parsed, when built with CSV_WITH_ZLIB or
+ * CSV_WITH_ZSTD. read_csv_columns and csv_read_rows need a plain file.
  * @param content: file path
  * @param csv: Pointer to a CSV struct
  */
 void read_csv(const char *content, CSV *csv);
 
+/*
+ * Maps a csv file read-only and parses it in place, every String_View in the
+ * header and rows points straight into the mapping, which lives until deinit_csv.
+ * May throw an error.
+ * @param content: file path
+ * @param csv: Pointer to a CSV struct
+ * @param sequential: Hints the kernel with MADV_SEQUENTIAL during the parse pass
+ */
+void read_csv_mmap(const char *content, CSV *csv, boolean sequential);
+
+/*
+ * Maps a csv file and parses it on several threads, each one handling a chunk
+ * aligned to record boundaries. Rows keep the file order. May throw an error.
+ * @param content: file path
+ * @param csv: Pointer to a CSV struct
+ * @param threads: Number of threads, 0 uses every online core
+ */
+void read_csv_parallel(const char *content, CSV *csv, u32 threads);
+
+/*
+ * Maps a csv file and keeps only the given columns, in the given order. The
+ * other fields are skipped by the scanner and never stored, and their names
+ * are not found by get_column_index anymore. May throw an error.
+ * @param content: file path
+ * @param names: Names of the columns to keep
+ * @param count: Number of names
+ * @param csv: Pointer to a CSV struct
+ */
+void read_csv_columns(const char *content, String_View *names, u32 count, CSV *csv);
+
+/*
+ * Reads a csv file on a separate thread while parsing it, so the time spent
+ * waiting for the disk overlaps with the parse. May throw an error.
+ * @param content: file path
+ * @param csv: Pointer to a CSV struct
+ * @param buffers: How many chunks of READER_CHUNK_SIZE bytes may be read ahead
+ * of the parser, 0 uses PIPELINE_BUFFERS
+ */
+void read_csv_pipelined(const char *content, CSV *csv, u32 buffers);
+
+/*
+ * Parses the bytes appended to a csv file since it was loaded (or last
+ * refreshed) and adds their rows to csv, growing its tables geometrically.
+ * Column types are promoted when the new rows need it, and typed columns
+ * already filled are extended, or dropped when their type changes. A last
+ * line without a newline is parsed again once it is finished. Works on
+ * csvs loaded by read_csv, read_csv_mmap, read_csv_parallel and
+ * read_csv_pipelined, unless lazy; append_row and append_column detach csv
+ * from its file. May throw an error.
+ * @param csv: Pointer to a loaded CSV struct
+ * @param content: file path it was loaded from
+ */
+void csv_refresh(CSV *csv, const char *content);
+
+/*
+ * Saves a parsed csv, its types, header and the typed columns already
+ * converted, to a binary cache tied to the source file's size, modification
+ * time and content. May throw an error.
+ * @param cache_path: cache file path
+ * @param source_path: path of the csv file csv was read from
+ * @param csv: Pointer to a CSV struct
+ */
+void csv_save_cache(const char *cache_path, const char *source_path, CSV *csv);
+
+/*
+ * Loads a csv saved by csv_save_cache with a single mapping of the cache, no
+ * parsing or type detection is done. Throws ERR_CACHE_STALE when the source
+ * file changed since the cache was saved. May throw an error.
+ * @param cache_path: cache file path
+ * @param source_path: path of the csv file the cache was saved from
+ * @param csv: Pointer to a CSV struct, freed with deinit_csv
+ */
+void csv_load_cache(const char *cache_path, const char *source_path, CSV *csv);
+
+/*
+ * Scans a csv file for record boundaries and saves the offset of every
+ * ROW_INDEX_STRIDE-th row next to it, in "<content>.idx". The index is only
+ * rebuilt when the file changed. May throw an error.
+ * @param content: file path
+ */
+void csv_build_row_index(const char *content);
+
+/*
+ * Reads rows [start, start + count) of a csv file, parsing only the blocks of
+ * the row index that hold them. The index is built first if needed, and
+ * rebuilt if it was built for another delimiter or quote than csv->dialect.
+ * May throw an error.
+ * @param content: file path
+ * @param start: First data row, 0 being the row after the header
+ * @param count: Number of rows, fewer are read if the file ends before
+ * @param csv: Pointer to a CSV struct
+ */
+void csv_read_rows(const char *content, u64 start, u64 count, CSV *csv);
+
+/*
+ * Opens a csv to be read in batches, decompressing it like read_csv does.
+ * reader->csv.dialect, layout and sampling may be set before the first batch.
+ * May throw an error.
+ * @param content: file path
+ * @param reader: Pointer to a CSV_Reader struct
+ * @param batch_rows: Rows per batch
+ */
+void csv_reader_open(const char *content, CSV_Reader *reader, u64 batch_rows);
+
+/*
+ * Reads the next batch of at most batch_rows rows. The previous batch is
+ * released. May throw an error.
+ * @param reader: Pointer to a CSV_Reader struct
+ * @return: The batch, valid until the next call, or NULL at the end of the file.
+ */
+CSV *csv_reader_next_batch(CSV_Reader *reader);
+
+/*
+ * Closes the file and frees every batch.
+ * @param reader: Pointer to a CSV_Reader struct
+ */
+void csv_reader_close(CSV_Reader *reader);
+
+/*
+ * Initializes a push parser. parser->csv.dialect may be set before the first
+ * feed, otherwise it is sniffed.
+ * @param parser: Pointer to a CSV_Parser struct
+ * @param on_row: Called for every row with the parser's csv, the row's cells,
+ * valid only during the call, and user_data
+ * @param user_data: Passed as is to on_row
+ */
+void csv_parser_init(CSV_Parser *parser, Row_Callback on_row, void *user_data);
+
+/*
+ * Pushes the next bytes of the input, the rows they complete are handed to
+ * on_row before returning. May throw an error.
+ * @param parser: Pointer to a CSV_Parser struct
+ * @param bytes: Next bytes of the input
+ * @param len: Number of bytes
+ */
+void csv_parser_feed(CSV_Parser *parser, const u8 *bytes, u64 len);
+
+/*
+ * Signals the end of the input, the last record is handed to on_row even
+ * without a trailing newline. May throw an error.
+ * @param parser: Pointer to a CSV_Parser struct
+ */
+void csv_parser_finish(CSV_Parser *parser);
+
+/*
+ * Frees the memory used by a push parser.
+ * @param parser: Pointer to a CSV_Parser struct
+ */
+void csv_parser_deinit(CSV_Parser *parser);
+
 /*
  * Saves the csv's content to a file, if output_file is NULL, saves into a predetermined name.
  * May throw an error.
@@ -191,14 +582,16 @@ boolean is_csv_empty(CSV *csv);
 boolean is_cell_empty(String_View cell);
 
 /*
- * Converts a cell's value to integer.
+ * Converts a cell's value to integer, reading the view in place eight digits
+ * at a time. Saturates on overflow like strtoll.
  * @param cell: A string_view of a cell.
  * @return signed integer: Signed value of a cell
  */
 s64 to_integer(String_View cell);
 
 /*
- * Converts a cell's value to floating point.
+ * Converts a cell's value to floating point, correctly rounded, reading the
+ * view in place. Only unusual inputs fall back to strtod.
  * @param cell: A string_view of a cell
  * @return double: double value of a cell
  */
@@ -222,6 +615,15 @@ void convert_cell_to_integer(CSV *csv, u32 row, u32 col, s64 *output);
  */
 void convert_cell_to_float(CSV *csv, u32 row, u32 col, double *output);
 
+/*
+ * Returns the typed values of an integer, float or boolean column, converting
+ * them on the first call. Numeric functions share this cache. May throw an error.
+ * @param csv: Pointer to a CSV struct.
+ * @param column_name: Name of the column.
+ * @return: Reference to the typed column.
+ */
+const Typed_Column *get_typed_column(CSV *csv, String_View column_name);
+
 /*
  * Fills empty values in a csv.
  * @param csv: Pointer to a CSV struct
@@ -259,7 +661,7 @@ void append_many_columns(CSV *csv, String_View **columns_to_append, u32 rows_to_
  * Appends a row to a csv, it need to has the same quantity of columns in the csv.
  * May throws an error.
  * @param csv: Pointer to a CSV struct.
- * @param row_to_append: Array to append.
+ * @param row_to_append: Array to append, copied into the csv. The cells keep pointing to the caller's data.
  * @param cols_to_append: cols of the row that will be append.
  */
 void append_row(CSV *csv, String_View *row_to_append, u32 cols_to_append);
@@ -332,7 +734,8 @@ u64 get_col_count(CSV *csv);
 const String_View *get_header(CSV *csv);
 
 /*
- * Returns a const reference of a line in csv. May throws an error.
+ * Returns a const reference of a line in csv. With CSV_LAYOUT_COLUMNS the
+ * line is copied to csv->scratch. May throws an error.
  * @param csv: Pointer to a CSV struct.
  * @param idx: Row index.
  * @return: Reference to a specific row.
@@ -340,7 +743,9 @@ const String_View *get_header(CSV *csv);
 const String_View *get_row_at(CSV *csv, u32 idx);
 
 /*
- * Returns a specific column. May thrown an error.
+ * Returns a specific column. With CSV_LAYOUT_ROWS the column is copied to
+ * csv->scratch, which arena_mark and arena_rewind can release once done with
+ * it. May thrown an error.
  * @param csv: Pointer to a CSV struct.
  * @param column_name: Column to be returned.
  * @return column: Reference to column.
@@ -357,7 +762,8 @@ const String_View *get_column(CSV *csv, String_View column_name);
 String_View get_cell(CSV *csv, u32 row, String_View *column_name);
 
 /*
- * Filter cells with function parameter. May throws an error.
+ * Filter cells with function parameter. The result lives in csv->scratch.
+ * May throws an error.
  * @param csv: Pointer to a CSV struct.
  * @param column_name: Name of the column.
  * @param predicate: Function utilized to filtrate.
@@ -366,6 +772,14 @@ String_View get_cell(CSV *csv, u32 row, String_View *column_name);
  */
 String_View *csv_filter(CSV *csv, String_View column_name, boolean (*predicate)(String_View cell), u64 *out_count);
 
+/*
+ * Reports how much memory a csv holds and what for. Tables loaded by
+ * csv_load_cache live in its mapping and only count as raw_buffer.
+ * @param csv: Pointer to a CSV struct.
+ * @param stats: Filled with the current figures.
+ */
+void csv_memory_stats(const CSV *csv, CSV_Memory_Stats *stats);
+
 /*  
  * CSV IMPLEMENTATION
  */
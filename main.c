@@ -14,7 +14,7 @@ int main() {
 
     //printf("--------------------------------------------------------------------------------\n");
     //print_csv(&csv);
-    const String_View *column = get_column(&csv, (String_View){ .data = "\"size\"", .size = strlen("\"size\"")});
+    const String_View *column = get_column(&csv, (String_View){ .data = "size", .size = strlen("size")});
     if (column == NULL)
     {
         if (error())
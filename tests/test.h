@@ -0,0 +1,246 @@
+#pragma once
+
+// mkstemp and unlink are not part of ISO C
+#define _GNU_SOURCE
+
+#include "../csvParser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEMP_FILES_MAX 32
+#define SAMPLE_COLS 5
+
+static u32 checks_failed = 0;
+static char temp_files[TEMP_FILES_MAX][32];
+static u32 temp_files_count = 0;
+
+// Reports a failed condition and keeps going, test_done turns failures into the exit status
+#define CHECK(cond)                                                                   \
+    do                                                                                \
+    {                                                                                 \
+        if (!(cond))                                                                  \
+        {                                                                             \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            checks_failed++;                                                          \
+        }                                                                             \
+    } while (0)
+
+// Replaces the content of a file, or appends to it
+static inline void write_file(const char *path, const void *bytes, u64 size, boolean append)
+{
+    FILE *file = fopen(path, append ? "ab" : "wb");
+    if (!file || fwrite(bytes, 1, size, file) != size)
+    {
+        fprintf(stderr, "cannot write %s\n", path);
+        exit(1);
+    }
+    fclose(file);
+}
+
+/*
+ * Writes bytes to a new file in /tmp, removed by test_done.
+ * @return: Path of the file.
+ */
+static inline const char *temp_file(const void *bytes, u64 size)
+{
+    if (temp_files_count == TEMP_FILES_MAX)
+    {
+        fprintf(stderr, "too many temp files\n");
+        exit(1);
+    }
+    char *path = temp_files[temp_files_count++];
+    strcpy(path, "/tmp/csv_test_XXXXXX");
+    s32 fd = mkstemp(path);
+    if (fd == -1)
+    {
+        fprintf(stderr, "cannot create %s\n", path);
+        exit(1);
+    }
+    close(fd);
+    write_file(path, bytes, size, FALSE);
+    return path;
+}
+
+// sv for string literals, whose bytes are char
+static inline String_View name_sv(const char *name)
+{
+    return (String_View){ .data = (u8 *)name, .size = strlen(name) };
+}
+
+static inline u64 sample_hash(u64 row, u64 col)
+{
+    u64 x = row * 0x9E3779B97F4A7C15ULL + col * 0xBF58476D1CE4E5B9ULL + 1;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/*
+ * Value of a cell of sample_csv, row 0 being the header. Columns are an
+ * integer, a string of 0 to 96 letters, a float, a boolean and a note, which
+ * holds delimiters, quotes and newlines when quoted.
+ * @return: Size of the value written to out, at most 128 bytes.
+ */
+static inline u64 sample_cell(u64 row, u64 col, u8 delimiter, boolean quoted, char *out)
+{
+    static const char *names[SAMPLE_COLS] = { "id", "name", "price", "active", "note" };
+    if (row == 0)
+    {
+        return sprintf(out, "%s", names[col]);
+    }
+
+    u64 h = sample_hash(row, col);
+    switch (col)
+    {
+        case 0:
+            return sprintf(out, "%lu", row);
+        case 2:
+            return sprintf(out, "%lu.%03lu", h % 100000, (h >> 20) % 1000);
+        case 3:
+            return sprintf(out, "%s", h % 2 ? "true" : "false");
+        case 4:
+            if (quoted && h % 4 == 0)
+            {
+                return sprintf(out, "a%cb \"c\"\nd%lu", delimiter, h % 1000);
+            }
+            h %= 40;
+            break;
+        default:
+            h %= 97;
+            break;
+    }
+    for (u64 i = 0; i < h; i++)
+    {
+        out[i] = 'a' + (row + i) % 26;
+    }
+    out[h] = '\0';
+    return h;
+}
+
+/*
+ * Builds a csv of SAMPLE_COLS columns and rows data rows, see sample_cell.
+ * Cells are quoted when they need it, and only then.
+ * @return: The text, freed by the caller, its size in *size.
+ */
+static inline char *sample_csv(u64 rows, u8 delimiter, boolean quoted, u64 *size)
+{
+    u64 capacity = (rows + 1) * SAMPLE_COLS * 260;
+    char *text = malloc(capacity);
+    u64 used = 0;
+    char cell[128];
+    for (u64 row = 0; row <= rows; row++)
+    {
+        for (u64 col = 0; col < SAMPLE_COLS; col++)
+        {
+            u64 len = sample_cell(row, col, delimiter, quoted, cell);
+            if (col > 0)
+            {
+                text[used++] = delimiter;
+            }
+            if (quoted && strpbrk(cell, "\"\n") != NULL)
+            {
+                text[used++] = '"';
+                for (u64 i = 0; i < len; i++)
+                {
+                    if (cell[i] == '"')
+                    {
+                        text[used++] = '"';
+                    }
+                    text[used++] = cell[i];
+                }
+                text[used++] = '"';
+            }
+            else
+            {
+                memcpy(text + used, cell, len);
+                used += len;
+            }
+        }
+        text[used++] = '\n';
+    }
+    *size = used;
+    return text;
+}
+
+static inline boolean same_cells(const String_View *a, const String_View *b, u64 count)
+{
+    if (!a || !b)
+    {
+        return FALSE;
+    }
+    for (u64 i = 0; i < count; i++)
+    {
+        if (a[i].size != b[i].size || (a[i].size && memcmp(a[i].data, b[i].data, a[i].size) != 0))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Checks that two csvs have the same header and the same rows
+static inline boolean same_csv(CSV *a, CSV *b)
+{
+    u64 cols = get_col_count(a);
+    if (get_row_count(a) != get_row_count(b) || cols != get_col_count(b) ||
+        !same_cells(get_header(a), get_header(b), cols))
+    {
+        return FALSE;
+    }
+    for (u64 row = 0; row + 1 < get_row_count(a); row++)
+    {
+        if (!same_cells(get_row_at(a, row), get_row_at(b, row), cols))
+        {
+            fprintf(stderr, "row %lu differs\n", row);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Checks that a csv holds the rows of sample_csv from its first data row
+static inline boolean is_sample(CSV *csv, u64 first, u64 rows, u8 delimiter, boolean quoted)
+{
+    if (get_row_count(csv) != rows + 1 || get_col_count(csv) != SAMPLE_COLS)
+    {
+        return FALSE;
+    }
+    char cell[128];
+    for (u64 row = 0; row <= rows; row++)
+    {
+        const String_View *cells = row == 0 ? get_header(csv) : get_row_at(csv, row - 1);
+        if (!cells)
+        {
+            return FALSE;
+        }
+        for (u64 col = 0; col < SAMPLE_COLS; col++)
+        {
+            u64 len = sample_cell(row == 0 ? 0 : first + row - 1, col, delimiter, quoted, cell);
+            if (cells[col].size != len || (len && memcmp(cells[col].data, cell, len) != 0))
+            {
+                fprintf(stderr, "row %lu col %lu differs\n", row, col);
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+// Removes the temp files and reports the result, returned by main
+static inline int test_done(const char *name)
+{
+    for (u32 i = 0; i < temp_files_count; i++)
+    {
+        unlink(temp_files[i]);
+    }
+    if (checks_failed)
+    {
+        printf("%s: %u checks failed\n", name, checks_failed);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
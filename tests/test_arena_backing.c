@@ -0,0 +1,70 @@
+#include "test.h"
+
+// Regions of HUGE_PAGE_SIZE and up are mapped, or the arena records that they were not
+static void check_region(const Arena *a, const Region *r)
+{
+    CHECK(r->capacity < HUGE_PAGE_SIZE || r->mapped >= r->capacity || (a->backing & ARENA_BACKING_FAILED));
+    CHECK(r->capacity >= HUGE_PAGE_SIZE || r->mapped == 0);
+}
+
+static void check_regions(const Arena *a)
+{
+    for (Region *r = a->begin; r; r = r->next)
+    {
+        check_region(a, r);
+    }
+    for (Region *r = a->large; r; r = r->next)
+    {
+        check_region(a, r);
+    }
+}
+
+int main()
+{
+    u32 backings[] = { ARENA_HUGE_PAGES, ARENA_HUGE_PAGES | ARENA_NUMA_LOCAL };
+    for (u32 i = 0; i < 2; i++)
+    {
+        Arena a = { .backing = backings[i] };
+        u8 *small = arena_alloc(&a, 1024);
+        u8 *large = arena_alloc(&a, 3 * HUGE_PAGE_SIZE);
+        for (u32 j = 0; j < 64; j++)
+        {
+            CHECK(arena_alloc(&a, REGION_DEFAULT_CAPACITY) != NULL);
+        }
+        CHECK(small && large);
+        memset(large, 'x', 3 * HUGE_PAGE_SIZE);
+        CHECK(large[3 * HUGE_PAGE_SIZE - 1] == 'x');
+        check_regions(&a);
+        arena_free(&a);
+    }
+
+    // The csv is the same whatever backs its memory
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+    CSV expected;
+    init_csv(&expected);
+    read_csv(path, &expected);
+    for (u32 i = 0; i < 2; i++)
+    {
+        CSV csv;
+        init_csv(&csv);
+        csv.allocator.backing = backings[i];
+        if (i == 0)
+        {
+            read_csv(path, &csv);
+        }
+        else
+        {
+            read_csv_parallel(path, &csv, 3);
+        }
+        CHECK(same_csv(&expected, &csv));
+        check_regions(&csv.allocator);
+        deinit_csv(&csv);
+    }
+    deinit_csv(&expected);
+
+    CHECK(!error());
+    free(text);
+    return test_done("arena_backing");
+}
@@ -0,0 +1,83 @@
+#include "test.h"
+
+// Region sizes double from REGION_DEFAULT_CAPACITY up to REGION_MAX_CAPACITY
+static void check_growth()
+{
+    Arena a = {0};
+    for (u32 i = 0; i < 50000; i++)
+    {
+        CHECK(arena_alloc(&a, 4096) != NULL);
+    }
+    u64 regions = 0;
+    u64 previous = 0;
+    for (Region *r = a.begin; r; r = r->next)
+    {
+        CHECK(r->capacity >= previous && r->capacity <= REGION_MAX_CAPACITY);
+        previous = r->capacity;
+        regions++;
+    }
+    CHECK(a.begin->capacity == REGION_DEFAULT_CAPACITY);
+    CHECK(regions <= 16);
+    arena_free(&a);
+}
+
+// An allocation larger than the next region leaves the current one in use
+static void check_large()
+{
+    Arena a = {0};
+    u8 *first = arena_alloc(&a, 100);
+    u8 *large = arena_alloc(&a, REGION_DEFAULT_CAPACITY * 4);
+    u8 *second = arena_alloc(&a, 100);
+    CHECK(first && large && second);
+    CHECK(second == first + ALIGN_UP(100, ALIGNMENT));
+    memset(large, 1, REGION_DEFAULT_CAPACITY * 4);
+    arena_free(&a);
+
+    // Reserved bytes are handed out from a single region
+    CHECK(arena_reserve(&a, 1000 * 64));
+    u8 *begin = arena_alloc(&a, 64);
+    for (u32 i = 1; i < 1000; i++)
+    {
+        CHECK(arena_alloc(&a, 64) == begin + i * 64);
+    }
+    arena_free(&a);
+}
+
+int main()
+{
+    check_growth();
+    check_large();
+
+    // The text gets a region of its size, rows take their cells from slabs
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+    CSV csv, mapped;
+    init_csv(&csv);
+    read_csv(path, &csv);
+    init_csv(&mapped);
+    read_csv_mmap(path, &mapped, FALSE);
+    CHECK(same_csv(&csv, &mapped));
+
+    u64 reserved = 0;
+    u64 used = 0;
+    for (Region *r = csv.allocator.begin; r; r = r->next)
+    {
+        reserved += r->capacity;
+        used += r->size;
+    }
+    CHECK(reserved <= 2 * used);
+
+    u64 contiguous = 0;
+    for (u64 row = 0; row + 2 < get_row_count(&csv); row++)
+    {
+        contiguous += csv.rows[row + 1].cells == csv.rows[row].cells + SAMPLE_COLS;
+    }
+    CHECK(contiguous * 10 >= (get_row_count(&csv) - 2) * 9);
+    deinit_csv(&csv);
+    deinit_csv(&mapped);
+
+    CHECK(!error());
+    free(text);
+    return test_done("arena_growth");
+}
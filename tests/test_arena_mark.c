@@ -0,0 +1,98 @@
+#include "test.h"
+
+static boolean long_note(String_View cell)
+{
+    return cell.size > 20;
+}
+
+// Bytes handed out by the regions of an arena
+static u64 arena_used(const Arena *a)
+{
+    u64 used = 0;
+    for (Region *r = a->begin; r; r = r->next)
+    {
+        used += r->size;
+    }
+    return used;
+}
+
+static void check_rewind()
+{
+    Arena a = {0};
+    u8 *kept = arena_alloc(&a, 100);
+    Arena_Mark mark = arena_mark(&a);
+    u64 used = arena_used(&a);
+    u8 *first = arena_alloc(&a, 200);
+    for (u32 i = 0; i < 100; i++)
+    {
+        arena_alloc(&a, REGION_DEFAULT_CAPACITY / 4);
+    }
+    arena_alloc(&a, REGION_MAX_CAPACITY + 1);
+    arena_rewind(&a, mark);
+    CHECK(arena_used(&a) == used && a.large == NULL);
+    CHECK(arena_alloc(&a, 200) == first);
+    CHECK(kept + ALIGN_UP(100, ALIGNMENT) == first);
+    arena_free(&a);
+}
+
+// Mark, alloc, rewind, reserve, realloc: the block is in a full region and must be copied to grow
+static void check_rewind_reserve()
+{
+    Arena a = {0};
+    Arena_Mark mark = arena_mark(&a);
+    arena_alloc(&a, REGION_DEFAULT_CAPACITY);
+    arena_alloc(&a, 1024);
+    arena_rewind(&a, mark);
+
+    u64 size = REGION_DEFAULT_CAPACITY - 64;
+    u8 *p = arena_alloc(&a, size);
+    memset(p, 'p', size);
+    CHECK(arena_reserve(&a, 4096));
+    CHECK(a.last == NULL);
+    u8 *grown = arena_realloc(&a, p, size, size + 4096);
+    CHECK(grown != p && grown[0] == 'p' && grown[size - 1] == 'p');
+    u8 *next = arena_alloc(&a, 16);
+    CHECK(next >= grown + size + 4096 || next + 16 <= grown);
+    arena_free(&a);
+}
+
+int main()
+{
+    check_rewind();
+    check_rewind_reserve();
+
+    // Query results go to csv->scratch and are released together
+    u64 size;
+    char *text = sample_csv(5000, ',', TRUE, &size);
+    CSV csv;
+    init_csv(&csv);
+    read_csv(temp_file(text, size), &csv);
+    Arena_Mark mark = arena_mark(&csv.scratch);
+    u64 used = arena_used(&csv.allocator);
+    for (u32 i = 0; i < 10; i++)
+    {
+        const String_View *column = get_column(&csv, name_sv("note"));
+        u64 count = 0;
+        String_View *filtered = csv_filter(&csv, name_sv("note"), long_note, &count);
+        u64 expected = 0;
+        for (u64 row = 0; column && row < 5000; row++)
+        {
+            CHECK(same_cells(&column[row + 1], &get_row_at(&csv, row)[4], 1));
+            if (long_note(column[row + 1]))
+            {
+                CHECK(filtered && expected < count && same_cells(&filtered[expected], &column[row + 1], 1));
+                expected++;
+            }
+        }
+        CHECK(count == expected && expected > 0);
+        CHECK(arena_used(&csv.scratch) > 0);
+        arena_rewind(&csv.scratch, mark);
+        CHECK(arena_used(&csv.scratch) == 0);
+    }
+    CHECK(arena_used(&csv.allocator) == used);
+    deinit_csv(&csv);
+
+    CHECK(!error());
+    free(text);
+    return test_done("arena_mark");
+}
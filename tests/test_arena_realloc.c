@@ -0,0 +1,93 @@
+#include "test.h"
+
+static void check_in_place()
+{
+    Arena a = {0};
+    u8 *p = arena_alloc(&a, 100);
+    memset(p, 'p', 100);
+    CHECK(arena_realloc(&a, p, 100, 1000) == p);
+    CHECK(arena_alloc(&a, 16) == p + ALIGN_UP(1000, ALIGNMENT));
+
+    // Only the most recent block grows in place, any other is copied
+    u8 *q = arena_alloc(&a, 64);
+    CHECK(arena_realloc(&a, q, 64, 32) == q);
+    CHECK(arena_alloc(&a, 16) == q + ALIGN_UP(32, ALIGNMENT));
+    u8 *moved = arena_realloc(&a, p, 1000, 2000);
+    CHECK(moved != p && moved[0] == 'p' && moved[99] == 'p');
+    arena_free(&a);
+}
+
+/*
+ * a->end moves past a full region to an empty one, the block last allocated
+ * in the full region must then be copied to grow, not extended in place.
+ */
+static void check_end_moves()
+{
+    Arena a = {0};
+    arena_alloc(&a, REGION_DEFAULT_CAPACITY);
+    arena_alloc(&a, 1024);
+    arena_reset(&a);
+
+    u64 size = REGION_DEFAULT_CAPACITY - 64;
+    u8 *p = arena_alloc(&a, size);
+    memset(p, 'p', size);
+    CHECK(arena_reserve(&a, 1024));
+    CHECK(a.last == NULL);
+    u8 *grown = arena_realloc(&a, p, size, size + 4096);
+    CHECK(grown != p && grown[0] == 'p' && grown[size - 1] == 'p');
+    arena_free(&a);
+}
+
+// Rows and columns appended one at a time must give the csv read from the whole file
+static void check_appends(CSV_Layout layout)
+{
+    u64 size;
+    char *text = sample_csv(5000, ',', FALSE, &size);
+    CSV expected, csv;
+    init_csv(&expected);
+    read_csv(temp_file(text, size), &expected);
+    free(text);
+
+    text = sample_csv(100, ',', FALSE, &size);
+    init_csv(&csv);
+    csv.layout = layout;
+    read_csv(temp_file(text, size), &csv);
+    free(text);
+    for (u64 row = 100; row < 5000; row++)
+    {
+        append_row(&csv, (String_View *)get_row_at(&expected, row), SAMPLE_COLS);
+    }
+    CHECK(same_csv(&expected, &csv));
+
+    String_View *column = malloc(sizeof(String_View) * get_row_count(&csv));
+    column[0] = name_sv("copy");
+    for (u64 row = 0; row < 5000; row++)
+    {
+        column[row + 1] = get_row_at(&expected, row)[0];
+    }
+    for (u32 i = 0; i < 3; i++)
+    {
+        append_column(&csv, column, get_row_count(&csv));
+    }
+    CHECK(get_col_count(&csv) == SAMPLE_COLS + 3);
+    for (u64 row = 0; row < 5000; row++)
+    {
+        const String_View *cells = get_row_at(&csv, row);
+        CHECK(same_cells(cells, get_row_at(&expected, row), SAMPLE_COLS));
+        CHECK(same_cells(&cells[SAMPLE_COLS], &column[row + 1], 1) && same_cells(&cells[SAMPLE_COLS + 2], &column[row + 1], 1));
+    }
+    free(column);
+    deinit_csv(&csv);
+    deinit_csv(&expected);
+}
+
+int main()
+{
+    check_in_place();
+    check_end_moves();
+    check_appends(CSV_LAYOUT_ROWS);
+    check_appends(CSV_LAYOUT_COLUMNS);
+
+    CHECK(!error());
+    return test_done("arena_realloc");
+}
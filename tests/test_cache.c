@@ -0,0 +1,77 @@
+#include "test.h"
+
+// Saves a cache of path and checks that loading it gives back the csv and its typed columns
+static void check_cache(const char *path, const char *cache, CSV_Layout layout, boolean typed)
+{
+    CSV expected, loaded;
+    init_csv(&expected);
+    expected.layout = layout;
+    expected.materialize_types = typed;
+    read_csv(path, &expected);
+    csv_save_cache(cache, path, &expected);
+
+    init_csv(&loaded);
+    csv_load_cache(cache, path, &loaded);
+    CHECK(loaded.layout == layout && loaded.mapping != NULL);
+    CHECK(same_csv(&expected, &loaded));
+    CHECK(memcmp(expected.type, loaded.type, sizeof(ColumnType) * SAMPLE_COLS) == 0);
+    CHECK(typed == (loaded.typed != NULL));
+    for (u64 col = 0; typed && loaded.typed && col < SAMPLE_COLS; col++)
+    {
+        const Typed_Column *a = &expected.typed[col];
+        const Typed_Column *b = &loaded.typed[col];
+        CHECK((a->valid != NULL) == (b->valid != NULL));
+        if (a->valid && b->valid)
+        {
+            size_t value_size = a->type == CSV_TYPE_BOOLEAN ? sizeof(boolean) : sizeof(s64);
+            CHECK(a->type == b->type && a->count == b->count);
+            CHECK(memcmp(a->valid, b->valid, a->count) == 0 && memcmp(a->values, b->values, a->count * value_size) == 0);
+        }
+    }
+
+    // Typed columns not saved are converted from the mapped cells
+    const Typed_Column *price = get_typed_column(&loaded, name_sv("price"));
+    CHECK(price && price->count == get_row_count(&expected) - 1);
+    deinit_csv(&loaded);
+    deinit_csv(&expected);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(5000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+    const char *cache = temp_file("", 0);
+    check_cache(path, cache, CSV_LAYOUT_ROWS, FALSE);
+    check_cache(path, cache, CSV_LAYOUT_ROWS, TRUE);
+    check_cache(path, cache, CSV_LAYOUT_COLUMNS, FALSE);
+    check_cache(path, cache, CSV_LAYOUT_COLUMNS, TRUE);
+    CHECK(!error());
+
+    // A truncated cache, then one whose source changed, are not loaded
+    FILE *file = fopen(cache, "rb");
+    fseek(file, 0, SEEK_END);
+    u64 cache_size = ftell(file);
+    rewind(file);
+    char *bytes = malloc(cache_size);
+    CHECK(fread(bytes, 1, cache_size, file) == cache_size);
+    fclose(file);
+    write_file(cache, bytes, cache_size / 2, FALSE);
+    CSV csv;
+    init_csv(&csv);
+    csv_load_cache(cache, path, &csv);
+    CHECK(csv.header == NULL);
+    deinit_csv(&csv);
+
+    write_file(cache, bytes, cache_size, FALSE);
+    write_file(path, "1,a,2.5,true,b\n", 15, TRUE);
+    init_csv(&csv);
+    csv_load_cache(cache, path, &csv);
+    CHECK(csv.header == NULL);
+    CHECK(error());
+    deinit_csv(&csv);
+
+    free(bytes);
+    free(text);
+    return test_done("cache");
+}
@@ -0,0 +1,54 @@
+#include "test.h"
+
+// Loads path in the column layout with every loader and compares it with the row layout
+static void check_columns(const char *path, u64 rows)
+{
+    CSV expected, csv;
+    init_csv(&expected);
+    read_csv(path, &expected);
+
+    for (u32 loader = 0; loader < 3; loader++)
+    {
+        init_csv(&csv);
+        csv.layout = CSV_LAYOUT_COLUMNS;
+        if (loader == 0)
+        {
+            read_csv(path, &csv);
+        }
+        else if (loader == 1)
+        {
+            read_csv_mmap(path, &csv, FALSE);
+        }
+        else
+        {
+            read_csv_parallel(path, &csv, 3);
+        }
+        CHECK(csv.columns != NULL);
+        CHECK(same_csv(&expected, &csv));
+
+        // Column arrays hold the header in slot 0 and the rows after it
+        String_View name = name_sv("price");
+        const String_View *column = get_column(&csv, name);
+        const String_View *copy = get_column(&expected, name);
+        CHECK(column == csv.columns[2]);
+        CHECK(same_cells(column, copy, rows + 1));
+        deinit_csv(&csv);
+    }
+    deinit_csv(&expected);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    check_columns(temp_file(text, size), 60000);
+    free(text);
+
+    // Fewer rows than ROWS_INITIAL_CAPACITY, the columns are not grown
+    text = sample_csv(10, ',', TRUE, &size);
+    check_columns(temp_file(text, size), 10);
+    free(text);
+
+    CHECK(!error());
+    return test_done("columns");
+}
@@ -0,0 +1,117 @@
+#include "test.h"
+
+#ifdef CSV_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSV_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// Every loader must decompress path to the rows read_csv finds in the plain file
+static void check_compressed(const char *plain, const char *path)
+{
+    CSV expected;
+    init_csv(&expected);
+    read_csv(plain, &expected);
+
+    for (u32 loader = 0; loader < 4; loader++)
+    {
+        CSV csv;
+        init_csv(&csv);
+        if (loader == 0)
+        {
+            read_csv(path, &csv);
+        }
+        else if (loader == 1)
+        {
+            read_csv_mmap(path, &csv, FALSE);
+        }
+        else if (loader == 2)
+        {
+            read_csv_parallel(path, &csv, 3);
+        }
+        else
+        {
+            read_csv_pipelined(path, &csv, 2);
+        }
+        CHECK(same_csv(&expected, &csv));
+        deinit_csv(&csv);
+    }
+
+    CSV_Reader reader;
+    csv_reader_open(path, &reader, 1000);
+    CSV *batch;
+    u64 row = 0;
+    while ((batch = csv_reader_next_batch(&reader)))
+    {
+        for (u64 i = 0; i + 1 < get_row_count(batch); i++, row++)
+        {
+            CHECK(row + 1 < get_row_count(&expected) &&
+                  same_cells(get_row_at(batch, i), get_row_at(&expected, row), SAMPLE_COLS));
+        }
+    }
+    CHECK(row + 1 == get_row_count(&expected));
+    csv_reader_close(&reader);
+    deinit_csv(&expected);
+}
+
+#ifdef CSV_WITH_ZLIB
+// Appends a gzip member holding bytes to out
+static u64 gzip(const char *bytes, u64 size, u8 *out)
+{
+    z_stream stream = {0};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    stream.next_in = (u8 *)bytes;
+    stream.avail_in = size;
+    stream.next_out = out;
+    stream.avail_out = deflateBound(&stream, size);
+    deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    return stream.total_out;
+}
+#endif
+
+int main()
+{
+    // Several READER_CHUNK_SIZE chunks once decompressed
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *plain = temp_file(text, size);
+    u8 *packed = malloc(size + size / 2 + 1024);
+    (void)plain; // without CSV_WITH_ZLIB and CSV_WITH_ZSTD there is nothing to check
+
+#ifdef CSV_WITH_ZLIB
+    u64 packed_size = gzip(text, size, packed);
+    check_compressed(plain, temp_file(packed, packed_size));
+
+    // Concatenated members are one stream
+    u64 half = size / 2;
+    packed_size = gzip(text, half, packed);
+    packed_size += gzip(text + half, size - half, packed + packed_size);
+    check_compressed(plain, temp_file(packed, packed_size));
+#endif
+
+#ifdef CSV_WITH_ZSTD
+    // Decoded past the last input byte, which the context still holds output for
+    u64 zstd_size = ZSTD_compress(packed, size + size / 2 + 1024, text, size, 3);
+    CHECK(!ZSTD_isError(zstd_size) && zstd_size < READER_CHUNK_SIZE && size > READER_CHUNK_SIZE);
+    const char *zstd_path = temp_file(packed, zstd_size);
+    check_compressed(plain, zstd_path);
+#endif
+
+    CHECK(!error());
+
+#ifdef CSV_WITH_ZLIB
+    // A truncated stream is an error, not a shorter file
+    packed_size = gzip(text, size, packed);
+    CSV csv;
+    init_csv(&csv);
+    read_csv(temp_file(packed, packed_size / 2), &csv);
+    CHECK(error());
+    deinit_csv(&csv);
+#endif
+
+    free(packed);
+    free(text);
+    return test_done("compressed");
+}
@@ -0,0 +1,88 @@
+#include "test.h"
+
+// Reads rows written with another dialect, sniffed or given, with read_csv and read_csv_mmap
+static void check_dialect(const char *path, const CSV_Dialect *dialect, u64 rows, u8 delimiter, boolean quoted)
+{
+    CSV expected, mapped;
+    init_csv(&expected);
+    init_csv(&mapped);
+    if (dialect)
+    {
+        expected.dialect = *dialect;
+        mapped.dialect = *dialect;
+    }
+    read_csv(path, &expected);
+    read_csv_mmap(path, &mapped, FALSE);
+    CHECK(is_sample(&expected, 1, rows, delimiter, quoted));
+    CHECK(same_csv(&expected, &mapped));
+    deinit_csv(&expected);
+    deinit_csv(&mapped);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+
+    // The first scan of the process runs on several workers at once
+    CSV parallel, expected;
+    init_csv(&parallel);
+    read_csv_parallel(path, &parallel, 4);
+    init_csv(&expected);
+    read_csv(path, &expected);
+    CHECK(same_csv(&expected, &parallel));
+    deinit_csv(&parallel);
+    deinit_csv(&expected);
+
+    // Specialized kernels for ';', '\t' and '|', the generic one for ':'
+    const u8 delimiters[] = { ';', '\t', '|', ':' };
+    for (u32 i = 0; i < sizeof(delimiters); i++)
+    {
+        u64 other_size;
+        char *other = sample_csv(60000, delimiters[i], TRUE, &other_size);
+        const char *other_path = temp_file(other, other_size);
+        CSV_Dialect sniffed = sniff_dialect((const u8 *)other, other_size);
+        CHECK(delimiters[i] == ':' || sniffed.delimiter == delimiters[i]);
+        CSV_Dialect dialect = { .delimiter = delimiters[i], .quote = '"', .crlf = FALSE, .trim = TRUE };
+        check_dialect(other_path, delimiters[i] == ':' ? &dialect : NULL, 60000, delimiters[i], TRUE);
+        free(other);
+    }
+    free(text);
+
+    // CRLF line endings are not part of the last cell
+    text = sample_csv(3000, ',', FALSE, &size);
+    char *crlf = malloc(size * 2);
+    u64 crlf_size = 0;
+    for (u64 i = 0; i < size; i++)
+    {
+        if (text[i] == '\n')
+        {
+            crlf[crlf_size++] = '\r';
+        }
+        crlf[crlf_size++] = text[i];
+    }
+    CHECK(sniff_dialect((const u8 *)crlf, crlf_size).crlf);
+    check_dialect(temp_file(crlf, crlf_size), NULL, 3000, ',', FALSE);
+    free(crlf);
+    free(text);
+
+    // Trimmed fields, and quotes kept as text when quoting is off
+    const char spaced[] = "a , b\n 1,\"x\" \n";
+    CSV csv;
+    init_csv(&csv);
+    read_csv(temp_file(spaced, strlen(spaced)), &csv);
+    const String_View *row = get_row_at(&csv, 0);
+    CHECK(get_header(&csv)[0].size == 1 && row && row[0].size == 1 && row[1].size == 1 && row[1].data[0] == 'x');
+    deinit_csv(&csv);
+
+    init_csv(&csv);
+    csv.dialect = (CSV_Dialect){ .delimiter = ',', .quote = 0, .crlf = FALSE, .trim = FALSE };
+    read_csv(temp_file(spaced, strlen(spaced)), &csv);
+    row = get_row_at(&csv, 0);
+    CHECK(get_header(&csv)[0].size == 2 && row && row[1].size == 4 && row[1].data[0] == '"');
+    deinit_csv(&csv);
+
+    CHECK(!error());
+    return test_done("dialect");
+}
@@ -0,0 +1,124 @@
+#include "test.h"
+
+static boolean has_note(String_View cell)
+{
+    return cell.size > 20;
+}
+
+// Whether a row of read_csv passes filter, checked here on the text
+static boolean passes(const String_View *cells, const Row_Filter *filter)
+{
+    if (filter->op == FILTER_PREDICATE)
+    {
+        return filter->predicate(cells[4]);
+    }
+    double value = to_float(cells[0]);
+    switch (filter->op)
+    {
+        case FILTER_LT:
+            return value < filter->value;
+        case FILTER_LE:
+            return value <= filter->value;
+        case FILTER_EQ:
+            return value == filter->value;
+        case FILTER_NE:
+            return value != filter->value;
+        case FILTER_GE:
+            return value >= filter->value;
+        default:
+            return value > filter->value;
+    }
+}
+
+// Every loader must keep the rows of read_csv that pass filter, in order
+static void check_filter(const char *path, Row_Filter filter)
+{
+    CSV all;
+    init_csv(&all);
+    read_csv(path, &all);
+
+    for (u32 loader = 0; loader < 5; loader++)
+    {
+        CSV csv;
+        init_csv(&csv);
+        csv.filter = filter;
+        CSV_Reader reader;
+        CSV *batch = NULL;
+        switch (loader)
+        {
+            case 0:
+                read_csv(path, &csv);
+                break;
+            case 1:
+                read_csv_mmap(path, &csv, FALSE);
+                break;
+            case 2:
+                read_csv_parallel(path, &csv, 3);
+                break;
+            case 3:
+                read_csv_pipelined(path, &csv, 2);
+                break;
+            default:
+                csv_reader_open(path, &reader, 1000);
+                reader.csv.filter = filter;
+                break;
+        }
+
+        u64 kept = 0;
+        u64 batch_row = 0;
+        for (u64 row = 0; row + 1 < get_row_count(&all); row++)
+        {
+            const String_View *cells = get_row_at(&all, row);
+            if (!passes(cells, &filter))
+            {
+                continue;
+            }
+            const String_View *got = NULL;
+            if (loader < 4)
+            {
+                got = kept + 1 < get_row_count(&csv) ? get_row_at(&csv, kept) : NULL;
+            }
+            else
+            {
+                while (batch_row + 1 >= (batch ? get_row_count(batch) : 0) &&
+                       (batch = csv_reader_next_batch(&reader)))
+                {
+                    batch_row = 0;
+                }
+                got = batch ? get_row_at(batch, batch_row++) : NULL;
+            }
+            CHECK(same_cells(got, cells, SAMPLE_COLS));
+            kept++;
+        }
+
+        if (loader < 4)
+        {
+            CHECK(get_row_count(&csv) == kept + 1);
+        }
+        else
+        {
+            CHECK(!batch || (batch_row + 1 == get_row_count(batch) && !csv_reader_next_batch(&reader)));
+            csv_reader_close(&reader);
+        }
+        deinit_csv(&csv);
+    }
+    deinit_csv(&all);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+
+    Filter_Op ops[] = { FILTER_LT, FILTER_LE, FILTER_EQ, FILTER_NE, FILTER_GE, FILTER_GT };
+    for (u32 i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        check_filter(path, (Row_Filter){ .op = ops[i], .column = name_sv("id"), .value = 25000 });
+    }
+    check_filter(path, (Row_Filter){ .op = FILTER_PREDICATE, .column = name_sv("note"), .predicate = has_note });
+
+    CHECK(!error());
+    free(text);
+    return test_done("filter");
+}
@@ -0,0 +1,74 @@
+#include "test.h"
+
+#define LATE_ROWS 20000
+
+static const ColumnType sample_types[SAMPLE_COLS] = {
+    CSV_TYPE_INTEGER, CSV_TYPE_STRING, CSV_TYPE_FLOAT, CSV_TYPE_BOOLEAN, CSV_TYPE_STRING
+};
+
+// Loads path with every loader and layout and checks the types found while parsing
+static void check_types(const char *path, const ColumnType *expected, u64 cols)
+{
+    for (u32 loader = 0; loader < 4; loader++)
+    {
+        CSV csv;
+        init_csv(&csv);
+        csv.layout = loader == 3 ? CSV_LAYOUT_COLUMNS : CSV_LAYOUT_ROWS;
+        if (loader == 1)
+        {
+            read_csv_mmap(path, &csv, FALSE);
+        }
+        else if (loader == 2)
+        {
+            read_csv_parallel(path, &csv, 4);
+        }
+        else
+        {
+            read_csv(path, &csv);
+        }
+        CHECK(get_col_count(&csv) == cols && memcmp(csv.type, expected, sizeof(ColumnType) * cols) == 0);
+        deinit_csv(&csv);
+    }
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    check_types(temp_file(text, size), sample_types, SAMPLE_COLS);
+    free(text);
+
+    // Columns that only turn into a float and a string late in the file
+    char *late = malloc(LATE_ROWS * 32);
+    u64 used = sprintf(late, "v,w,x\n");
+    for (u64 row = 0; row < LATE_ROWS; row++)
+    {
+        used += sprintf(late + used, row == 15000 ? "2.5,%lu,-%lu\n" : row == 15001 ? "%lu,x,-%lu\n" : "%lu,%lu,-%lu\n", row, row, row);
+    }
+    const char *path = temp_file(late, used);
+    const ColumnType late_types[] = { CSV_TYPE_FLOAT, CSV_TYPE_STRING, CSV_TYPE_INTEGER };
+    check_types(path, late_types, 3);
+
+    // Sampled types are promoted once the whole column is converted
+    CSV csv;
+    init_csv(&csv);
+    csv.sampling = (Type_Sampling){ .head_rows = 100, .one_in = 1000000 };
+    read_csv(path, &csv);
+    CHECK(csv.types_sampled);
+    CHECK(csv.type[0] == CSV_TYPE_INTEGER || csv.type[0] == CSV_TYPE_FLOAT);
+    const Typed_Column *v = get_typed_column(&csv, name_sv("v"));
+    CHECK(v && v->type == CSV_TYPE_FLOAT && csv.type[0] == CSV_TYPE_FLOAT);
+    CHECK(v && v->floats[15000] == 2.5 && v->floats[LATE_ROWS - 1] == LATE_ROWS - 1);
+    deinit_csv(&csv);
+
+    init_csv(&csv);
+    csv.sampling = (Type_Sampling){ .head_rows = 100, .one_in = 1000000 };
+    csv.materialize_types = TRUE;
+    read_csv(path, &csv);
+    CHECK(memcmp(csv.type, late_types, sizeof(late_types)) == 0);
+    deinit_csv(&csv);
+
+    CHECK(!error());
+    free(late);
+    return test_done("infer");
+}
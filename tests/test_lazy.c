@@ -0,0 +1,64 @@
+#include "test.h"
+
+static void check_lazy(const char *path, u32 loader, const char *cache)
+{
+    CSV expected, lazy;
+    init_csv(&expected);
+    read_csv(path, &expected);
+    init_csv(&lazy);
+    lazy.lazy = TRUE;
+    if (loader == 0)
+    {
+        read_csv(path, &lazy);
+    }
+    else if (loader == 1)
+    {
+        read_csv_mmap(path, &lazy, FALSE);
+    }
+    else
+    {
+        read_csv_parallel(path, &lazy, 3);
+    }
+    CHECK(lazy.row_starts != NULL);
+    CHECK(memcmp(expected.type, lazy.type, sizeof(ColumnType) * SAMPLE_COLS) == 0);
+
+    // Rows split out of order, then every row
+    u64 last = get_row_count(&expected) - 2;
+    CHECK(same_cells(get_row_at(&lazy, last), get_row_at(&expected, last), SAMPLE_COLS));
+    CHECK(same_cells(get_row_at(&lazy, last / 2), get_row_at(&expected, last / 2), SAMPLE_COLS));
+    CHECK(same_csv(&expected, &lazy));
+
+    double a, b;
+    csv_mean(&expected, name_sv("price"), &a);
+    csv_mean(&lazy, name_sv("price"), &b);
+    CHECK(a == b);
+    deinit_csv(&expected);
+
+    // A lazy csv saves every row to the cache
+    init_csv(&expected);
+    expected.lazy = TRUE;
+    read_csv(path, &expected);
+    csv_save_cache(cache, path, &expected);
+    deinit_csv(&expected);
+    init_csv(&expected);
+    csv_load_cache(cache, path, &expected);
+    CHECK(same_csv(&expected, &lazy));
+    deinit_csv(&expected);
+    deinit_csv(&lazy);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+    const char *cache = temp_file("", 0);
+    for (u32 loader = 0; loader < 3; loader++)
+    {
+        check_lazy(path, loader, cache);
+    }
+
+    CHECK(!error());
+    free(text);
+    return test_done("lazy");
+}
@@ -0,0 +1,106 @@
+#include "test.h"
+
+static boolean long_note(String_View cell)
+{
+    return cell.size > 20;
+}
+
+// The totals are ordered, and the categories are within what the arenas reserved
+static void check_totals(const CSV_Memory_Stats *stats)
+{
+    CHECK(stats->requested <= stats->used && stats->used <= stats->reserved);
+    CHECK(stats->requested <= stats->peak);
+    CHECK(stats->regions > 0);
+    CHECK(stats->row_tables + stats->cells + stats->typed_columns <= stats->reserved);
+}
+
+static u64 file_size(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    fseek(file, 0, SEEK_END);
+    u64 size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+int main()
+{
+    const u64 rows = 20000;
+    u64 size;
+    char *text = sample_csv(rows, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+    const char *cache = temp_file("", 0);
+    CSV_Memory_Stats stats;
+
+    // Text copied to the arena, row layout
+    CSV csv;
+    init_csv(&csv);
+    read_csv(path, &csv);
+    csv_memory_stats(&csv, &stats);
+    check_totals(&stats);
+    CHECK(stats.raw_buffer >= size && stats.raw_buffer <= size + 1);
+    CHECK(stats.cells >= (rows + 1) * SAMPLE_COLS * sizeof(String_View));
+    CHECK(stats.row_tables >= rows * sizeof(Row));
+    CHECK(stats.typed_columns == 0 && stats.query_temporaries == 0);
+    CHECK(stats.hash_entries > 0);
+
+    // Query results are counted while they are held, and only then
+    CSV_Memory_Stats before = stats;
+    Arena_Mark mark = arena_mark(&csv.scratch);
+    u64 count = 0;
+    CHECK(get_column(&csv, name_sv("note")) != NULL);
+    CHECK(csv_filter(&csv, name_sv("note"), long_note, &count) != NULL);
+    csv_memory_stats(&csv, &stats);
+    check_totals(&stats);
+    CHECK(stats.query_temporaries >= (rows + 1 + count) * sizeof(String_View));
+    CHECK(stats.requested == before.requested + stats.query_temporaries);
+    arena_rewind(&csv.scratch, mark);
+    csv_memory_stats(&csv, &stats);
+    CHECK(stats.query_temporaries == 0 && stats.requested == before.requested);
+    CHECK(stats.peak >= before.requested + (rows + 1) * sizeof(String_View));
+
+    CHECK(get_typed_column(&csv, name_sv("price")) != NULL);
+    csv_memory_stats(&csv, &stats);
+    check_totals(&stats);
+    CHECK(stats.typed_columns >= rows * (sizeof(boolean) + sizeof(s64)));
+    csv_save_cache(cache, path, &csv);
+    deinit_csv(&csv);
+
+    // Mapped file, the whole mapping is raw buffer
+    init_csv(&csv);
+    read_csv_mmap(path, &csv, TRUE);
+    csv_memory_stats(&csv, &stats);
+    check_totals(&stats);
+    CHECK(stats.raw_buffer == size);
+    deinit_csv(&csv);
+
+    // Columns layout
+    init_csv(&csv);
+    csv.layout = CSV_LAYOUT_COLUMNS;
+    read_csv(path, &csv);
+    csv_memory_stats(&csv, &stats);
+    check_totals(&stats);
+    CHECK(stats.cells >= (rows + 1) * SAMPLE_COLS * sizeof(String_View));
+    CHECK(stats.row_tables == SAMPLE_COLS * sizeof(String_View *));
+    deinit_csv(&csv);
+
+    // Loaded from the cache: the tables live in the mapping, which counts as raw buffer
+    CSV expected;
+    init_csv(&expected);
+    read_csv(path, &expected);
+    init_csv(&csv);
+    csv_load_cache(cache, path, &csv);
+    CHECK(same_csv(&expected, &csv));
+    csv_memory_stats(&csv, &stats);
+    CHECK(stats.raw_buffer == file_size(cache));
+    CHECK(stats.cells == 0 && stats.row_tables == 0 && stats.typed_columns == 0);
+    CHECK(stats.requested <= stats.used && stats.used <= stats.reserved);
+    deinit_csv(&csv);
+    deinit_csv(&expected);
+
+    CHECK(!error());
+    csv_memory_stats(NULL, &stats);
+    CHECK(error());
+    free(text);
+    return test_done("memory_stats");
+}
@@ -0,0 +1,37 @@
+#include "test.h"
+
+// read_csv_mmap must give the same cells as read_csv, with or without a last newline
+static void check_mmap(const char *path, boolean sequential)
+{
+    CSV expected, mapped;
+    init_csv(&expected);
+    init_csv(&mapped);
+    read_csv(path, &expected);
+    read_csv_mmap(path, &mapped, sequential);
+    CHECK(mapped.mapping != NULL);
+    CHECK(same_csv(&expected, &mapped));
+    deinit_csv(&expected);
+    deinit_csv(&mapped);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(3000, ',', FALSE, &size);
+    const char *path = temp_file(text, size);
+    const char *unterminated = temp_file(text, size - 1);
+
+    CSV csv;
+    init_csv(&csv);
+    read_csv(unterminated, &csv);
+    CHECK(is_sample(&csv, 1, 3000, ',', FALSE));
+    deinit_csv(&csv);
+
+    check_mmap(path, FALSE);
+    check_mmap(path, TRUE);
+    check_mmap(unterminated, FALSE);
+
+    CHECK(!error());
+    free(text);
+    return test_done("mmap");
+}
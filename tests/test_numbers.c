@@ -0,0 +1,104 @@
+#include "test.h"
+
+#define NUMBERS 300000
+
+static u64 next_random(u64 *state)
+{
+    return sample_hash(++*state, 0);
+}
+
+static u64 random_digits(u64 *state, char *out, u64 max)
+{
+    u64 count = next_random(state) % (max + 1);
+    for (u64 i = 0; i < count; i++)
+    {
+        out[i] = '0' + next_random(state) % 10;
+    }
+    return count;
+}
+
+/*
+ * Writes a random decimal with up to 20 integer and 20 fraction digits and
+ * an optional exponent.
+ */
+static u64 random_float(u64 *state, char *out)
+{
+    u64 size = 0;
+    u64 r = next_random(state);
+    if (r % 4 == 0)
+    {
+        out[size++] = r % 8 == 0 ? '-' : '+';
+    }
+    u64 integer = random_digits(state, out + size, r % 3 == 0 ? 20 : 6);
+    size += integer;
+    u64 fraction = 0;
+    if (integer == 0 || r % 5 != 0)
+    {
+        out[size++] = '.';
+        fraction = random_digits(state, out + size, r % 7 == 0 ? 20 : 8);
+        size += fraction;
+    }
+    if (integer + fraction == 0)
+    {
+        out[size++] = '0';
+    }
+    if (r % 6 == 0)
+    {
+        size += sprintf(out + size, "e%ld", (s64)(next_random(state) % 700) - 350);
+    }
+    out[size] = '\0';
+    return size;
+}
+
+int main()
+{
+    char text[96];
+    u64 state = 0;
+    u64 mismatches = 0;
+    for (u32 i = 0; i < NUMBERS; i++)
+    {
+        u64 size = random_float(&state, text);
+        double expected = strtod(text, NULL);
+        // A digit right after the view, which must not be read
+        text[size] = '7';
+        double value = to_float((String_View){ .data = (u8 *)text, .size = size });
+        text[size] = '\0';
+        if (memcmp(&value, &expected, sizeof(double)) != 0 && mismatches++ < 5)
+        {
+            fprintf(stderr, "to_float(%s) = %.17g, strtod gives %.17g\n", text, value, expected);
+        }
+    }
+    CHECK(mismatches == 0);
+
+    // Integers of every length, the longest ones saturating like strtoll
+    mismatches = 0;
+    for (u32 i = 0; i < NUMBERS; i++)
+    {
+        u64 size = 0;
+        u64 r = next_random(&state);
+        if (r % 3 == 0)
+        {
+            text[size++] = '-';
+        }
+        text[size++] = '1' + r % 9;
+        size += random_digits(&state, text + size, r % 10 == 0 ? 24 : 18);
+        text[size] = '\0';
+        s64 expected = strtoll(text, NULL, 10);
+        text[size] = '5';
+        s64 value = to_integer((String_View){ .data = (u8 *)text, .size = size });
+        text[size] = '\0';
+        if (value != expected && mismatches++ < 5)
+        {
+            fprintf(stderr, "to_integer(%s) = %ld, strtoll gives %ld\n", text, value, expected);
+        }
+    }
+    CHECK(mismatches == 0);
+
+    // Cells longer than the 21 bytes the conversions used to copy
+    const char *longer = "0000000000000000000000000000000000000042.5000000000000000000000000001";
+    CHECK(to_float((String_View){ .data = (u8 *)longer, .size = strlen(longer) }) == 42.5);
+    CHECK(to_integer((String_View){ .data = (u8 *)longer, .size = 40 }) == 42);
+
+    CHECK(!error());
+    return test_done("numbers");
+}
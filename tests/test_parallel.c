@@ -0,0 +1,41 @@
+#include "test.h"
+
+// Every thread count must give the rows of read_csv, in file order
+static void check_parallel(const char *path, u32 threads)
+{
+    CSV expected, parallel;
+    init_csv(&expected);
+    init_csv(&parallel);
+    read_csv(path, &expected);
+    read_csv_parallel(path, &parallel, threads);
+    CHECK(same_csv(&expected, &parallel));
+    deinit_csv(&expected);
+    deinit_csv(&parallel);
+}
+
+int main()
+{
+    // Over PARALLEL_MIN_CHUNK_SIZE per thread, so the file is split in chunks
+    u64 size;
+    char *text = sample_csv(60000, ',', FALSE, &size);
+    CHECK(size > 4 * PARALLEL_MIN_CHUNK_SIZE);
+    const char *path = temp_file(text, size);
+    const char *unterminated = temp_file(text, size - 1);
+
+    u32 threads[] = { 0, 1, 2, 3, 4, 7 };
+    for (u32 i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+    {
+        check_parallel(path, threads[i]);
+        check_parallel(unterminated, threads[i]);
+    }
+
+    CSV csv;
+    init_csv(&csv);
+    read_csv_parallel(path, &csv, 4);
+    CHECK(is_sample(&csv, 1, 60000, ',', FALSE));
+    deinit_csv(&csv);
+
+    CHECK(!error());
+    free(text);
+    return test_done("parallel");
+}
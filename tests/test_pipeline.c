@@ -0,0 +1,53 @@
+#include "test.h"
+
+static void check_pipelined(const char *path, u32 buffers, CSV_Layout layout)
+{
+    CSV expected, csv;
+    init_csv(&expected);
+    init_csv(&csv);
+    csv.layout = layout;
+    read_csv(path, &expected);
+    read_csv_pipelined(path, &csv, buffers);
+    CHECK(same_csv(&expected, &csv));
+    deinit_csv(&expected);
+    deinit_csv(&csv);
+}
+
+int main()
+{
+    // Several READER_CHUNK_SIZE reads, with quoted records cut between them
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+    for (u32 buffers = 0; buffers <= 4; buffers++)
+    {
+        check_pipelined(path, buffers, CSV_LAYOUT_ROWS);
+    }
+    check_pipelined(path, 2, CSV_LAYOUT_COLUMNS);
+    check_pipelined(temp_file(text, size - 1), 2, CSV_LAYOUT_ROWS);
+    free(text);
+
+    // A quoted record over many reads, whose newlines are not record ends
+    u64 parts = READER_CHUNK_SIZE / 2;
+    char *long_text = malloc(parts * 8 + 32);
+    u64 used = sprintf(long_text, "a,b\n1,x\n2,\"");
+    for (u64 i = 0; i < parts; i++)
+    {
+        memcpy(long_text + used, i % 2 ? "y\n,\"\"" : "zz\n", i % 2 ? 5 : 3);
+        used += i % 2 ? 5 : 3;
+    }
+    used += sprintf(long_text + used, "\"\n3,z\n");
+    path = temp_file(long_text, used);
+    check_pipelined(path, 1, CSV_LAYOUT_ROWS);
+    check_pipelined(path, 3, CSV_LAYOUT_ROWS);
+
+    CSV csv;
+    init_csv(&csv);
+    read_csv_pipelined(path, &csv, 2);
+    CHECK(get_row_count(&csv) == 4);
+    deinit_csv(&csv);
+    free(long_text);
+
+    CHECK(!error());
+    return test_done("pipeline");
+}
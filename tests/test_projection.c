@@ -0,0 +1,57 @@
+#include "test.h"
+
+// The kept columns, in the given order, must hold the cells of read_csv
+static void check_projection(const char *path, CSV_Layout layout, const char **names, const u64 *cols, u32 count)
+{
+    CSV expected, csv;
+    init_csv(&expected);
+    read_csv(path, &expected);
+
+    String_View views[SAMPLE_COLS];
+    for (u32 i = 0; i < count; i++)
+    {
+        views[i] = name_sv(names[i]);
+    }
+    init_csv(&csv);
+    csv.layout = layout;
+    read_csv_columns(path, views, count, &csv);
+    CHECK(get_col_count(&csv) == count && get_row_count(&csv) == get_row_count(&expected));
+
+    for (u64 row = 0; row + 1 < get_row_count(&expected) && get_col_count(&csv) == count; row++)
+    {
+        const String_View *cells = get_row_at(&csv, row);
+        const String_View *all = get_row_at(&expected, row);
+        for (u32 i = 0; cells && all && i < count; i++)
+        {
+            CHECK(same_cells(&cells[i], &all[cols[i]], 1));
+        }
+    }
+    for (u32 i = 0; i < count && get_col_count(&csv) == count; i++)
+    {
+        CHECK(same_cells(&get_header(&csv)[i], &get_header(&expected)[cols[i]], 1));
+        CHECK(csv.type[i] == expected.type[cols[i]]);
+        CHECK(get_column_index(&views[i]) == (s32)i);
+    }
+    deinit_csv(&csv);
+    deinit_csv(&expected);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+
+    const char *some[] = { "note", "id", "price" };
+    const u64 some_cols[] = { 4, 0, 2 };
+    check_projection(path, CSV_LAYOUT_ROWS, some, some_cols, 3);
+    check_projection(path, CSV_LAYOUT_COLUMNS, some, some_cols, 3);
+
+    const char *last[] = { "note" };
+    const u64 last_cols[] = { 4 };
+    check_projection(path, CSV_LAYOUT_ROWS, last, last_cols, 1);
+
+    CHECK(!error());
+    free(text);
+    return test_done("projection");
+}
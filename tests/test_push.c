@@ -0,0 +1,57 @@
+#include "test.h"
+
+typedef struct Push_Check {
+    CSV *expected;
+    u64 rows;
+} Push_Check;
+
+static void on_row(const CSV *csv, const String_View *row, void *user_data)
+{
+    Push_Check *check = user_data;
+    CHECK(csv->cols_count == get_col_count(check->expected));
+    CHECK(check->rows + 1 < get_row_count(check->expected) &&
+          same_cells(row, get_row_at(check->expected, check->rows), csv->cols_count));
+    check->rows++;
+}
+
+// Pushes text in pieces of chunk bytes, or of every size from 0 to 96 when chunk is 0
+static void check_push(CSV *expected, const char *text, u64 size, u64 chunk)
+{
+    Push_Check check = { .expected = expected, .rows = 0 };
+    CSV_Parser parser;
+    csv_parser_init(&parser, on_row, &check);
+    u64 fed = 0;
+    for (u64 i = 1; fed < size; i++)
+    {
+        u64 len = chunk ? chunk : i % 97;
+        len = len < size - fed ? len : size - fed;
+        csv_parser_feed(&parser, (const u8 *)text + fed, len);
+        fed += len;
+    }
+    csv_parser_finish(&parser);
+    CHECK(same_cells(get_header(&parser.csv), get_header(expected), get_col_count(expected)));
+    CHECK(check.rows + 1 == get_row_count(expected));
+    csv_parser_deinit(&parser);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(5000, ',', TRUE, &size);
+    CSV expected;
+    init_csv(&expected);
+    read_csv(temp_file(text, size), &expected);
+
+    u64 chunks[] = { 1, 3, 64, 4096, size, 0 };
+    for (u32 i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        check_push(&expected, text, size, chunks[i]);
+    }
+    // The last record is handed over by csv_parser_finish
+    check_push(&expected, text, size - 1, 4096);
+    deinit_csv(&expected);
+
+    CHECK(!error());
+    free(text);
+    return test_done("push");
+}
@@ -0,0 +1,64 @@
+#include "test.h"
+
+#define LONG_FIELD_PARTS 300
+
+int main()
+{
+    // A quarter of the notes are quoted and hold a delimiter, a newline and an escaped quote
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+
+    CSV expected, other;
+    init_csv(&expected);
+    read_csv(path, &expected);
+    CHECK(is_sample(&expected, 1, 60000, ',', TRUE));
+
+    init_csv(&other);
+    read_csv_mmap(path, &other, FALSE);
+    CHECK(same_csv(&expected, &other));
+    deinit_csv(&other);
+
+    // Chunks are split at newlines, some of them inside quoted fields
+    for (u32 threads = 2; threads <= 5; threads++)
+    {
+        init_csv(&other);
+        read_csv_parallel(path, &other, threads);
+        CHECK(same_csv(&expected, &other));
+        deinit_csv(&other);
+    }
+    deinit_csv(&expected);
+
+    // A quoted field over many blocks, with the quote state carried from one to the next
+    char *long_text = malloc(LONG_FIELD_PARTS * 5 + 32);
+    char *value = malloc(LONG_FIELD_PARTS * 4);
+    u64 used = sprintf(long_text, "a,b\n1,\"");
+    for (u32 i = 0; i < LONG_FIELD_PARTS; i++)
+    {
+        memcpy(long_text + used, "x,\n\"\"", 5);
+        memcpy(value + i * 4, "x,\n\"", 4);
+        used += 5;
+    }
+    used += sprintf(long_text + used, "\"\n2,y\n");
+    path = temp_file(long_text, used);
+
+    init_csv(&expected);
+    read_csv(path, &expected);
+    CHECK(get_row_count(&expected) == 3);
+    const String_View *row = get_row_at(&expected, 0);
+    CHECK(row && row[1].size == LONG_FIELD_PARTS * 4 && memcmp(row[1].data, value, row[1].size) == 0);
+    row = get_row_at(&expected, 1);
+    CHECK(row && row[1].size == 1 && row[1].data[0] == 'y');
+
+    init_csv(&other);
+    read_csv_mmap(path, &other, TRUE);
+    CHECK(same_csv(&expected, &other));
+    deinit_csv(&other);
+    deinit_csv(&expected);
+
+    CHECK(!error());
+    free(value);
+    free(long_text);
+    free(text);
+    return test_done("quoted");
+}
@@ -0,0 +1,57 @@
+#include "test.h"
+
+// Reads path in batches and checks them, in order, against the rows of read_csv
+static void check_reader(const char *path, u64 batch_rows, u64 max_carry)
+{
+    CSV expected;
+    init_csv(&expected);
+    read_csv(path, &expected);
+
+    CSV_Reader reader;
+    csv_reader_open(path, &reader, batch_rows);
+    CSV *batch;
+    u64 row = 0;
+    while ((batch = csv_reader_next_batch(&reader)))
+    {
+        u64 rows = get_row_count(batch) - 1;
+        CHECK(rows > 0 && rows <= batch_rows);
+        CHECK(same_cells(get_header(batch), get_header(&expected), get_col_count(&expected)));
+        for (u64 i = 0; i < rows && row + i + 1 < get_row_count(&expected); i++)
+        {
+            CHECK(same_cells(get_row_at(batch, i), get_row_at(&expected, row + i), get_col_count(&expected)));
+        }
+        row += rows;
+        CHECK(reader.carry_capacity <= max_carry);
+    }
+    CHECK(row + 1 == get_row_count(&expected));
+    csv_reader_close(&reader);
+    deinit_csv(&expected);
+}
+
+int main()
+{
+    // Records cut by the end of every READER_CHUNK_SIZE read, some inside quotes
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+    u64 batches[] = { 1, 7, 1000, 100000 };
+    for (u32 i = 0; i < sizeof(batches) / sizeof(batches[0]); i++)
+    {
+        check_reader(path, batches[i], 4 * READER_CHUNK_SIZE);
+    }
+    check_reader(temp_file(text, size - 1), 1000, 4 * READER_CHUNK_SIZE);
+    free(text);
+
+    // A quoted record longer than a chunk grows the carry until it fits
+    u64 long_size = READER_CHUNK_SIZE * 3 / 2;
+    char *long_text = malloc(long_size + 32);
+    u64 used = sprintf(long_text, "a,b\n1,x\n2,\"");
+    memset(long_text + used, 'y', long_size);
+    used += long_size;
+    used += sprintf(long_text + used, "\"\n3,z\n");
+    check_reader(temp_file(long_text, used), 2, 8 * READER_CHUNK_SIZE);
+    free(long_text);
+
+    CHECK(!error());
+    return test_done("reader");
+}
@@ -0,0 +1,89 @@
+#include "test.h"
+
+// csv must hold what read_csv finds in the file now, typed columns included
+static void check_refreshed(CSV *csv, const char *path)
+{
+    CSV expected;
+    init_csv(&expected);
+    read_csv(path, &expected);
+    CHECK(same_csv(&expected, csv));
+    CHECK(memcmp(expected.type, csv->type, sizeof(ColumnType) * SAMPLE_COLS) == 0);
+
+    const Typed_Column *price = get_typed_column(csv, name_sv("price"));
+    CHECK(price && price->count == get_row_count(&expected) - 1);
+    for (u64 row = 0; price && row < price->count; row++)
+    {
+        String_View cell = get_row_at(&expected, row)[2];
+        CHECK(price->valid[row] == !is_cell_empty(cell));
+        CHECK(!price->valid[row] || price->floats[row] == to_float(cell));
+    }
+    deinit_csv(&expected);
+}
+
+static void check_refresh(const char *path, const char *text, u64 size, u32 loader, CSV_Layout layout)
+{
+    // The first half, cut in the middle of a row
+    u64 cut = size / 2;
+    write_file(path, text, cut, FALSE);
+    CSV csv;
+    init_csv(&csv);
+    csv.layout = layout;
+    csv.materialize_types = TRUE;
+    if (loader == 0)
+    {
+        read_csv(path, &csv);
+    }
+    else if (loader == 1)
+    {
+        read_csv_mmap(path, &csv, FALSE);
+    }
+    else if (loader == 2)
+    {
+        read_csv_parallel(path, &csv, 3);
+    }
+    else
+    {
+        read_csv_pipelined(path, &csv, 2);
+    }
+    check_refreshed(&csv, path);
+
+    // The cut row is parsed again once finished, in pieces of every size
+    u64 step = 1;
+    while (cut < size)
+    {
+        u64 len = step < size - cut ? step : size - cut;
+        write_file(path, text + cut, len, TRUE);
+        cut += len;
+        step *= 7;
+        csv_refresh(&csv, path);
+        check_refreshed(&csv, path);
+    }
+
+    // Nothing appended
+    csv_refresh(&csv, path);
+    check_refreshed(&csv, path);
+
+    // Rows that turn the integer column into floats
+    const char promote[] = "2.5,x,1.5,true,\n7,y,2,false,z\n";
+    write_file(path, promote, strlen(promote), TRUE);
+    csv_refresh(&csv, path);
+    check_refreshed(&csv, path);
+    CHECK(csv.type[0] == CSV_TYPE_FLOAT);
+    deinit_csv(&csv);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(60000, ',', TRUE, &size);
+    const char *path = temp_file("", 0);
+    for (u32 loader = 0; loader < 4; loader++)
+    {
+        check_refresh(path, text, size, loader, CSV_LAYOUT_ROWS);
+    }
+    check_refresh(path, text, size, 0, CSV_LAYOUT_COLUMNS);
+
+    CHECK(!error());
+    free(text);
+    return test_done("refresh");
+}
@@ -0,0 +1,62 @@
+#include "test.h"
+
+// Rows [start, start + count) read through the index must be those of read_csv
+static void check_rows(CSV *expected, const char *path, u64 start, u64 count)
+{
+    u64 total = get_row_count(expected) - 1;
+    u64 rows = count < total - start ? count : total - start;
+    CSV csv;
+    init_csv(&csv);
+    csv_read_rows(path, start, count, &csv);
+    CHECK(get_row_count(&csv) == rows + 1);
+    CHECK(same_cells(get_header(&csv), get_header(expected), SAMPLE_COLS));
+    for (u64 row = 0; row < rows && row + 1 < get_row_count(&csv); row++)
+    {
+        CHECK(same_cells(get_row_at(&csv, row), get_row_at(expected, start + row), SAMPLE_COLS));
+    }
+    deinit_csv(&csv);
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(5000, ',', TRUE, &size);
+    const char *path = temp_file(text, size);
+    char index[64];
+    snprintf(index, sizeof(index), "%s%s", path, ROW_INDEX_SUFFIX);
+
+    CSV expected;
+    init_csv(&expected);
+    read_csv(path, &expected);
+    csv_build_row_index(path);
+    CHECK(access(index, F_OK) == 0);
+
+    u64 starts[] = { 0, 1, ROW_INDEX_STRIDE - 1, ROW_INDEX_STRIDE, ROW_INDEX_STRIDE + 1, 3 * ROW_INDEX_STRIDE + 7, 4990 };
+    for (u32 i = 0; i < sizeof(starts) / sizeof(starts[0]); i++)
+    {
+        check_rows(&expected, path, starts[i], 1);
+        check_rows(&expected, path, starts[i], ROW_INDEX_STRIDE + 3);
+    }
+    check_rows(&expected, path, 0, 5000);
+    deinit_csv(&expected);
+
+    // The index is rebuilt once the file changed
+    write_file(path, text + size / 2, size - size / 2, TRUE);
+    init_csv(&expected);
+    read_csv(path, &expected);
+    check_rows(&expected, path, 4000, 3000);
+    deinit_csv(&expected);
+
+    CHECK(!error());
+
+    // Starting after the last row is out of bounds
+    CSV csv;
+    init_csv(&csv);
+    csv_read_rows(path, 9000, 1, &csv);
+    CHECK(error());
+    deinit_csv(&csv);
+
+    unlink(index);
+    free(text);
+    return test_done("row_index");
+}
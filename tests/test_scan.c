@@ -0,0 +1,46 @@
+#include "test.h"
+
+/*
+ * The names column is 0 to 96 bytes long, so delimiters and newlines fall at
+ * every offset of the 64-byte blocks the vector kernels classify. The cells
+ * are checked against the text sample_csv wrote, byte by byte. The files end
+ * without a newline.
+ */
+int main()
+{
+    u64 size;
+    char *text = sample_csv(2000, ',', FALSE, &size);
+    const char *path = temp_file(text, size - 1);
+
+    CSV csv;
+    init_csv(&csv);
+    read_csv(path, &csv);
+    CHECK(is_sample(&csv, 1, 2000, ',', FALSE));
+    deinit_csv(&csv);
+
+    // Files ending at every offset of a block, the last one parsed from a partial block
+    u64 rows = 0;
+    u64 end = 0;
+    for (u32 i = 0; i < 200 && end < size; i++)
+    {
+        while (text[end] != '\n')
+        {
+            end++;
+        }
+        write_file(path, text, end++, FALSE);
+        CSV expected, mapped;
+        init_csv(&expected);
+        init_csv(&mapped);
+        read_csv(path, &expected);
+        read_csv_mmap(path, &mapped, FALSE);
+        CHECK(is_sample(&expected, 1, rows, ',', FALSE));
+        CHECK(same_csv(&expected, &mapped));
+        deinit_csv(&expected);
+        deinit_csv(&mapped);
+        rows++;
+    }
+
+    CHECK(!error());
+    free(text);
+    return test_done("scan");
+}
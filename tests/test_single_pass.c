@@ -0,0 +1,46 @@
+#include "test.h"
+
+static void check_cells(const String_View *cells, const char **expected, u64 count)
+{
+    for (u64 i = 0; cells && i < count; i++)
+    {
+        CHECK(cells[i].size == strlen(expected[i]));
+        CHECK(cells[i].size == 0 || memcmp(cells[i].data, expected[i], cells[i].size) == 0);
+    }
+    CHECK(cells != NULL);
+}
+
+int main()
+{
+    // More rows than ROWS_INITIAL_CAPACITY, the table grows while they are split
+    u64 size;
+    char *text = sample_csv(5000, ',', FALSE, &size);
+    const char *path = temp_file(text, size);
+    CSV csv;
+    init_csv(&csv);
+    read_csv(path, &csv);
+    CHECK(is_sample(&csv, 1, 5000, ',', FALSE));
+    deinit_csv(&csv);
+
+    // The header alone gives the column count
+    const char header_only[] = "a,b,c\n";
+    init_csv(&csv);
+    read_csv(temp_file(header_only, strlen(header_only)), &csv);
+    CHECK(get_row_count(&csv) == 1);
+    CHECK(get_col_count(&csv) == 3);
+    deinit_csv(&csv);
+
+    // Missing fields are empty cells
+    const char short_rows[] = "a,b,c\n1\n4,5,6\n,,\n";
+    init_csv(&csv);
+    read_csv(temp_file(short_rows, strlen(short_rows)), &csv);
+    CHECK(get_row_count(&csv) == 4);
+    check_cells(get_row_at(&csv, 0), (const char *[]){ "1", "", "" }, 3);
+    check_cells(get_row_at(&csv, 1), (const char *[]){ "4", "5", "6" }, 3);
+    check_cells(get_row_at(&csv, 2), (const char *[]){ "", "", "" }, 3);
+    deinit_csv(&csv);
+
+    CHECK(!error());
+    free(text);
+    return test_done("single_pass");
+}
@@ -0,0 +1,80 @@
+#include "test.h"
+
+#include <math.h>
+
+static boolean close_to(double a, double b)
+{
+    return fabs(a - b) <= 1e-9 * fmax(1.0, fabs(b));
+}
+
+// Typed values must match the conversion of every cell of the text
+static void check_typed(CSV *csv, u64 rows)
+{
+    const Typed_Column *id = get_typed_column(csv, name_sv("id"));
+    const Typed_Column *price = get_typed_column(csv, name_sv("price"));
+    const Typed_Column *active = get_typed_column(csv, name_sv("active"));
+    CHECK(id && id->type == CSV_TYPE_INTEGER && id->count == rows);
+    CHECK(price && price->type == CSV_TYPE_FLOAT && price->count == rows);
+    CHECK(active && active->type == CSV_TYPE_BOOLEAN && active->count == rows);
+    if (!id || !price || !active)
+    {
+        return;
+    }
+
+    double sum = 0;
+    for (u64 row = 0; row < rows; row++)
+    {
+        const String_View *cells = get_row_at(csv, row);
+        CHECK(id->valid[row] && id->integers[row] == to_integer(cells[0]));
+        CHECK(price->valid[row] && price->floats[row] == to_float(cells[2]));
+        CHECK(active->valid[row] && active->booleans[row] == (cells[3].data[0] == 't'));
+        sum += to_float(cells[2]);
+    }
+
+    double mean, median, sd;
+    csv_mean(csv, name_sv("price"), &mean);
+    CHECK(close_to(mean, sum / rows));
+    csv_median(csv, name_sv("id"), &median);
+    CHECK(close_to(median, (rows + 1) / 2.0));
+    csv_sd(csv, name_sv("id"), &sd);
+    CHECK(close_to(sd * sd, ((double)rows * rows - 1) / 12.0));
+}
+
+int main()
+{
+    u64 size;
+    char *text = sample_csv(5000, ',', FALSE, &size);
+    const char *path = temp_file(text, size);
+
+    CSV csv;
+    init_csv(&csv);
+    read_csv(path, &csv);
+    CHECK(csv.typed == NULL || !csv.typed[0].valid);
+    check_typed(&csv, 5000);
+    deinit_csv(&csv);
+
+    // Converted at load time, then read from the same arrays
+    init_csv(&csv);
+    csv.materialize_types = TRUE;
+    read_csv(path, &csv);
+    CHECK(csv.typed != NULL && csv.typed[0].valid != NULL);
+    check_typed(&csv, 5000);
+    deinit_csv(&csv);
+
+    // Empty cells are not valid, and a column of them has a median of 0
+    const char empty[] = "a,b\n1,\n,\n3,\n";
+    init_csv(&csv);
+    read_csv(temp_file(empty, strlen(empty)), &csv);
+    const Typed_Column *a = get_typed_column(&csv, name_sv("a"));
+    CHECK(a && a->count == 3 && a->valid[0] && !a->valid[1] && a->integers[1] == 0 && a->integers[2] == 3);
+    double median = -1;
+    csv_median(&csv, name_sv("a"), &median);
+    CHECK(median == 2.0);
+    csv_median(&csv, name_sv("b"), &median);
+    CHECK(median == 0.0);
+    deinit_csv(&csv);
+
+    CHECK(!error());
+    free(text);
+    return test_done("typed");
+}